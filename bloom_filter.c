@@ -0,0 +1,55 @@
+#include "bloom_filter.h"
+
+/* initialize a filter for n keys at bits_per_key bits each */
+void bloom_init(bloom_filter_t *bf, size_t n, size_t bits_per_key)
+{
+	assert(bf && bits_per_key > 0);
+
+	size_t block_bits = BLOOM_BLOCK_WORDS * 64;
+	size_t blocks = (n * bits_per_key + block_bits - 1) / block_bits;
+	bf->block_count = 2;
+	bf->block_shift = 63;
+	while (bf->block_count < blocks) {
+		bf->block_count *= 2;
+		bf->block_shift--;
+	}
+
+	/* k = bits_per_key * ln 2 minimizes the false positive rate */
+	bf->k = (bits_per_key * 69 + 50) / 100;
+	if (bf->k < 1) {
+		bf->k = 1;
+	} else if (bf->k > BLOOM_MAX_K) {
+		bf->k = BLOOM_MAX_K;
+	}
+	bf->bits_per_key = bits_per_key;
+
+	size_t size = sizeof(uint64) * BLOOM_BLOCK_WORDS * bf->block_count;
+	void *blocks_ptr = NULL;
+	int ret = posix_memalign(&blocks_ptr, sizeof(uint64) * BLOOM_BLOCK_WORDS,
+			size);
+	assert(ret == 0);
+	(void)ret;
+	bf->blocks = blocks_ptr;
+	memset(bf->blocks, 0, size);
+}
+
+/* destroy the filter */
+void bloom_destroy(bloom_filter_t *bf)
+{
+	assert(bf);
+
+	free(bf->blocks);
+	bf->blocks = NULL;
+	bf->block_count = 0;
+}
+
+/* removes all keys */
+void bloom_clear(bloom_filter_t *bf)
+{
+	assert(bf);
+
+	if (bf->blocks != NULL) {
+		memset(bf->blocks, 0,
+			sizeof(uint64) * BLOOM_BLOCK_WORDS * bf->block_count);
+	}
+}
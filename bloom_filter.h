@@ -0,0 +1,82 @@
+#ifndef _BLOOM_FILTER_H_
+#define _BLOOM_FILTER_H_
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+
+#define BLOOM_BLOCK_WORDS	8	/* 512 bits, one cache line per block */
+#define BLOOM_MAX_K		7	/* 9 bits of hash select each bit */
+
+typedef struct bloom_filter bloom_filter_t;
+
+/*
+ * blocked bloom filter, all k bits of a key are in one cache line. a
+ * filter answers "maybe present" or "certainly absent", keys cannot be
+ * removed.
+ */
+struct bloom_filter {
+	uint64 *blocks;			/* NULL when the filter is not in use */
+	size_t block_count;		/* a power of two, at least 2 */
+	unsigned int block_shift;	/* 64 - log2(block_count) */
+	unsigned int k;			/* bits set per key */
+	size_t bits_per_key;
+};
+
+/* function prototype */
+void bloom_init(bloom_filter_t *bf, size_t n, size_t bits_per_key);
+void bloom_destroy(bloom_filter_t *bf);
+void bloom_clear(bloom_filter_t *bf);
+
+/* block of a hash, from the high bits of a multiplicative mix */
+static inline uint64* __bloom_block(bloom_filter_t *bf, uint64 hashval)
+{
+	size_t index = (hashval * 0x9e3779b97f4a7c15ull) >> bf->block_shift;
+	return bf->blocks + index * BLOOM_BLOCK_WORDS;
+}
+
+/* adds a key by its 64 bit hash */
+static inline void bloom_add_hashed(bloom_filter_t *bf, uint64 hashval)
+{
+	assert(bf && bf->blocks);
+
+	uint64 *block = __bloom_block(bf, hashval);
+	uint64 bits = __hash_mix64(hashval, WYP0);
+	unsigned int i;
+	for (i = 0; i < bf->k; i++, bits >>= 9) {
+		block[(bits >> 6) & 7] |= (uint64)1 << (bits & 63);
+	}
+}
+
+/* returns 0 if the key with this hash was never added, 1 if it may be */
+static inline int bloom_contains_hashed(bloom_filter_t *bf, uint64 hashval)
+{
+	assert(bf && bf->blocks);
+
+	uint64 *block = __bloom_block(bf, hashval);
+	uint64 bits = __hash_mix64(hashval, WYP0);
+	unsigned int i;
+	for (i = 0; i < bf->k; i++, bits >>= 9) {
+		if (!(block[(bits >> 6) & 7] & ((uint64)1 << (bits & 63)))) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* adds length bytes at key */
+static inline void bloom_add(bloom_filter_t *bf, const void *key,
+		size_t length)
+{
+	bloom_add_hashed(bf, hash64(key, length));
+}
+
+/* checks length bytes at key, see bloom_contains_hashed */
+static inline int bloom_contains(bloom_filter_t *bf, const void *key,
+		size_t length)
+{
+	return bloom_contains_hashed(bf, hash64(key, length));
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * scaling benchmark of concurrent_hash_set_t against a hash_set_t behind
+ * one mutex. every thread runs the same mix of finds, inserts and erases
+ * on random keys, throughput is printed for 1, 2, 4 ... max_threads.
+ *
+ * gcc -O2 -DNDEBUG -std=gnu99 chset_bench.c concurrent_hash_set.c \
+ *	hash_set.c bloom_filter.c vector.c -lpthread -o chset_bench
+ * ./chset_bench [max_threads] [ops_per_thread] [find_percent]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include "concurrent_hash_set.h"
+#include "hash_set.h"
+
+#define BENCH_KEY_RANGE		(1 << 20)	/* keys are drawn from [0, range) */
+
+struct bench_task {
+	concurrent_hash_set_t *ch;	/* NULL for the locked hash_set_t */
+	hash_set_t *h;
+	pthread_mutex_t *lock;
+	size_t ops;
+	unsigned int find_percent;
+	uint64 seed;
+	pthread_t thread;
+};
+
+static size_t ops_per_thread = 1000000;
+static unsigned int find_percent = 80;
+
+/* xorshift64, one state per thread */
+static inline uint64 __bench_rand(uint64 *state)
+{
+	uint64 x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+static void* __bench_run(void *arg)
+{
+	struct bench_task *t = arg;
+	uint64 state = t->seed;
+	size_t i;
+	for (i = 0; i < t->ops; i++) {
+		uint64 r = __bench_rand(&state);
+		uint64 key = (r >> 8) % BENCH_KEY_RANGE;
+		unsigned int op = r % 100;
+		uint64 found;
+
+		if (t->ch != NULL) {
+			if (op < t->find_percent) {
+				chset_find(t->ch, &key, &found);
+			} else if (op % 2) {
+				chset_insert(t->ch, &key);
+			} else {
+				chset_erase(t->ch, &key);
+			}
+			continue;
+		}
+
+		pthread_mutex_lock(t->lock);
+		if (op < t->find_percent) {
+			iterator_t it;
+			hset_find(t->h, &key, &it);
+		} else if (op % 2) {
+			hset_insert(t->h, &key);
+		} else {
+			hset_erase(t->h, &key);
+		}
+		pthread_mutex_unlock(t->lock);
+	}
+
+	return NULL;
+}
+
+static double __bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* runs threads tasks and returns million operations per second */
+static double __bench(concurrent_hash_set_t *ch, hash_set_t *h,
+		pthread_mutex_t *lock, size_t threads)
+{
+	struct bench_task *tasks = calloc(threads, sizeof(struct bench_task));
+	assert(tasks);
+
+	size_t i;
+	double start = __bench_now();
+	for (i = 0; i < threads; i++) {
+		tasks[i].ch = ch;
+		tasks[i].h = h;
+		tasks[i].lock = lock;
+		tasks[i].ops = ops_per_thread;
+		tasks[i].find_percent = find_percent;
+		tasks[i].seed = 0x9e3779b97f4a7c15ull * (i + 1);
+		pthread_create(&tasks[i].thread, NULL, __bench_run, &tasks[i]);
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(tasks[i].thread, NULL);
+	}
+	double elapsed = __bench_now() - start;
+
+	free(tasks);
+	return threads * ops_per_thread / elapsed / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t max_threads = (argc > 1) ? strtoul(argv[1], NULL, 10) : 8;
+	if (argc > 2) {
+		ops_per_thread = strtoul(argv[2], NULL, 10);
+	}
+	if (argc > 3) {
+		find_percent = strtoul(argv[3], NULL, 10);
+	}
+
+	printf("%zu ops per thread, %u%% find, keys in [0, %d)\n",
+			ops_per_thread, find_percent, BENCH_KEY_RANGE);
+	printf("threads\tchset Mops/s\tmutex+hset Mops/s\n");
+
+	size_t threads;
+	for (threads = 1; threads <= max_threads; threads *= 2) {
+		concurrent_hash_set_t ch;
+		hash_set_t h;
+		pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+		CHSET_INIT(&ch, sizeof(uint64));
+		HSET_INIT(&h, sizeof(uint64));
+
+		/* start half full so erases and inserts both find work */
+		uint64 key;
+		for (key = 0; key < BENCH_KEY_RANGE; key += 2) {
+			chset_insert(&ch, &key);
+			hset_insert(&h, &key);
+		}
+
+		double c = __bench(&ch, NULL, NULL, threads);
+		double m = __bench(NULL, &h, &lock, threads);
+		printf("%zu\t%.2f\t\t%.2f\n", threads, c, m);
+
+		chset_destroy(&ch);
+		hset_destroy(&h);
+	}
+
+	return 0;
+}
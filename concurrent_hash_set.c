@@ -0,0 +1,353 @@
+#include <sched.h>
+#include "concurrent_hash_set.h"
+
+#define LOAD(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/* function prototypes */
+static struct chset_table* __chset_alloc_table(size_t bucket_size);
+static void __chset_free_table(concurrent_hash_set_t *h,
+		struct chset_table *t, int free_elements);
+static void __chset_resize(concurrent_hash_set_t *h, size_t bucket_size);
+static void __chset_lock_all(concurrent_hash_set_t *h);
+static void __chset_unlock_all(concurrent_hash_set_t *h);
+static struct chset_reader* __chset_read_lock(concurrent_hash_set_t *h,
+		int *parity);
+static void __chset_read_unlock(struct chset_reader *r, int parity);
+static void __chset_retire(concurrent_hash_set_t *h, struct chain_node *n);
+static void __chset_reclaim(concurrent_hash_set_t *h, vector_t *nodes);
+
+/* reader slot of the calling thread, assigned on its first read */
+static __thread int reader_slot = -1;
+static unsigned int next_reader_slot;
+
+/* initialize the hash set */
+void chset_init(concurrent_hash_set_t *h, size_t elem_size,
+		void (*copy_func)(void *, void *),
+		void (*free_func)(void *),
+		int (*cmp_func)(void *, void *))
+{
+	assert(h && elem_size > 0);
+
+	memset(h, 0, sizeof(concurrent_hash_set_t));
+	h->table = __chset_alloc_table(
+			(DEFAULT_CONTAINER_CAPACITY > CHSET_LOCK_STRIPES) ?
+			DEFAULT_CONTAINER_CAPACITY : CHSET_LOCK_STRIPES);
+	h->elem_size = elem_size;
+	h->key_size = elem_size;
+	h->copy = copy_func;
+	h->free = free_func;
+	h->compare = cmp_func;
+	h->hash = hash64;
+
+	size_t i;
+	for (i = 0; i < CHSET_LOCK_STRIPES; i++) {
+		pthread_mutex_init(&h->locks[i], NULL);
+	}
+	pthread_mutex_init(&h->sync_lock, NULL);
+	pthread_mutex_init(&h->retire_lock, NULL);
+	VECTOR_INIT(&h->retired, sizeof(struct chain_node *));
+}
+
+/* destroy the hash set, no other thread may use it any more */
+void chset_destroy(concurrent_hash_set_t *h)
+{
+	assert(h);
+
+	__chset_reclaim(h, &h->retired);
+	vector_destroy(&h->retired);
+	__chset_free_table(h, h->table, 1);
+	h->table = NULL;
+
+	size_t i;
+	for (i = 0; i < CHSET_LOCK_STRIPES; i++) {
+		pthread_mutex_destroy(&h->locks[i]);
+	}
+	pthread_mutex_destroy(&h->sync_lock);
+	pthread_mutex_destroy(&h->retire_lock);
+}
+
+/* remove all elements, readers still see the old table until they leave */
+void chset_clear(concurrent_hash_set_t *h)
+{
+	assert(h);
+
+	__chset_lock_all(h);
+	struct chset_table *old = h->table;
+	STORE(&h->table, __chset_alloc_table(old->bucket_size));
+	__atomic_store_n(&h->size, 0, __ATOMIC_RELAXED);
+	__chset_unlock_all(h);
+
+	chset_synchronize(h);
+	__chset_free_table(h, old, 1);
+}
+
+/* inserts elements */
+void chset_insert(concurrent_hash_set_t *h, void *key)
+{
+	assert(h && key);
+
+	uint64 hashval = h->hash(key, h->key_size);
+	pthread_mutex_t *lock = &h->locks[hashval & (CHSET_LOCK_STRIPES - 1)];
+	pthread_mutex_lock(lock);
+
+	/* the table is only replaced while all stripes are held */
+	struct chset_table *t = h->table;
+	struct bucket *b = &t->buckets[hashval & (t->bucket_size - 1)];
+	struct chain_node *next;
+	for (next = b->first; next != NULL; next = next->next) {
+		if (next->hash == hashval && EQUALS(key, next->data, h)) {
+			pthread_mutex_unlock(lock);
+			return;
+		}
+	}
+
+	struct chain_node *n = malloc(sizeof(struct chain_node) + h->elem_size);
+	assert(n);
+	n->hash = hashval;
+	n->next = b->first;
+	CONTAINER_COPY(n->data, key, h);
+	STORE(&b->first, n);
+	b->size++;
+	size_t size = __atomic_add_fetch(&h->size, 1, __ATOMIC_RELAXED);
+	size_t bucket_size = t->bucket_size;
+	pthread_mutex_unlock(lock);
+
+	if (size > bucket_size) {
+		__chset_resize(h, bucket_size * 2);
+	}
+}
+
+/* erases elements */
+void chset_erase(concurrent_hash_set_t *h, void *key)
+{
+	assert(h && key);
+
+	uint64 hashval = h->hash(key, h->key_size);
+	pthread_mutex_t *lock = &h->locks[hashval & (CHSET_LOCK_STRIPES - 1)];
+	pthread_mutex_lock(lock);
+
+	struct chset_table *t = h->table;
+	struct bucket *b = &t->buckets[hashval & (t->bucket_size - 1)];
+	struct chain_node **link = &b->first;
+	while (*link != NULL) {
+		struct chain_node *n = *link;
+		if (n->hash == hashval && EQUALS(key, n->data, h)) {
+			/* readers on n still reach the rest of the chain */
+			STORE(link, n->next);
+			b->size--;
+			__atomic_sub_fetch(&h->size, 1, __ATOMIC_RELAXED);
+			pthread_mutex_unlock(lock);
+			__chset_retire(h, n);
+			return;
+		}
+
+		link = &n->next;
+	}
+
+	pthread_mutex_unlock(lock);
+}
+
+/*
+ * finds element with specific key without locking, returns 1 and copies
+ * it to element if element is not NULL, else returns 0
+ */
+int chset_find(concurrent_hash_set_t *h, void *key, void *element)
+{
+	assert(h && key);
+
+	uint64 hashval = h->hash(key, h->key_size);
+	int parity;
+	struct chset_reader *r = __chset_read_lock(h, &parity);
+
+	struct chset_table *t = LOAD(&h->table);
+	struct chain_node *next = LOAD(&t->buckets[hashval &
+			(t->bucket_size - 1)].first);
+	while (next != NULL) {
+		if (next->hash == hashval && EQUALS(key, next->data, h)) {
+			if (element != NULL) {
+				CONTAINER_COPY(element, next->data, h);
+			}
+			__chset_read_unlock(r, parity);
+			return 1;
+		}
+
+		next = LOAD(&next->next);
+	}
+
+	__chset_read_unlock(r, parity);
+	return 0;
+}
+
+/* waits until every reader that may see memory unlinked so far has left */
+void chset_synchronize(concurrent_hash_set_t *h)
+{
+	assert(h);
+
+	pthread_mutex_lock(&h->sync_lock);
+	unsigned long epoch = __atomic_fetch_add(&h->epoch, 1, __ATOMIC_SEQ_CST);
+	int parity = epoch & 1;
+
+	size_t i;
+	for (i = 0; i < CHSET_READER_SLOTS; i++) {
+		while (__atomic_load_n(&h->readers[i].count[parity],
+					__ATOMIC_SEQ_CST) != 0) {
+			sched_yield();
+		}
+	}
+	pthread_mutex_unlock(&h->sync_lock);
+}
+
+static struct chset_table* __chset_alloc_table(size_t bucket_size)
+{
+	struct chset_table *t = malloc(sizeof(struct chset_table) +
+			sizeof(struct bucket) * bucket_size);
+	assert(t);
+	t->bucket_size = bucket_size;
+	memset(t->buckets, 0, sizeof(struct bucket) * bucket_size);
+	return t;
+}
+
+/* frees the nodes of a table no reader can reach any more */
+static void __chset_free_table(concurrent_hash_set_t *h,
+		struct chset_table *t, int free_elements)
+{
+	size_t i;
+	for (i = 0; i < t->bucket_size; i++) {
+		struct chain_node *next = t->buckets[i].first;
+		while (next != NULL) {
+			struct chain_node *tmp = next->next;
+			if (free_elements && h->free != NULL) {
+				h->free(next->data);
+			}
+			free(next);
+			next = tmp;
+		}
+	}
+
+	free(t);
+}
+
+/*
+ * builds a table of bucket_size buckets from copies of the nodes, since
+ * readers may be walking the old chains, and publishes it. writers wait
+ * on the stripe locks, readers are never blocked.
+ */
+static void __chset_resize(concurrent_hash_set_t *h, size_t bucket_size)
+{
+	__chset_lock_all(h);
+
+	struct chset_table *old = h->table;
+	if (old->bucket_size >= bucket_size) {
+		/* another thread resized first */
+		__chset_unlock_all(h);
+		return;
+	}
+
+	struct chset_table *t = __chset_alloc_table(bucket_size);
+	size_t node_size = sizeof(struct chain_node) + h->elem_size;
+	size_t i;
+	for (i = 0; i < old->bucket_size; i++) {
+		struct chain_node *next;
+		for (next = old->buckets[i].first; next != NULL;
+				next = next->next) {
+			struct chain_node *n = malloc(node_size);
+			assert(n);
+			memcpy(n, next, node_size);
+			struct bucket *b = &t->buckets[n->hash & (bucket_size - 1)];
+			n->next = b->first;
+			b->first = n;
+			b->size++;
+		}
+	}
+
+	STORE(&h->table, t);
+	__chset_unlock_all(h);
+
+	/* the elements now belong to the copies */
+	chset_synchronize(h);
+	__chset_free_table(h, old, 0);
+}
+
+/* stripes are always taken in index order */
+static void __chset_lock_all(concurrent_hash_set_t *h)
+{
+	size_t i;
+	for (i = 0; i < CHSET_LOCK_STRIPES; i++) {
+		pthread_mutex_lock(&h->locks[i]);
+	}
+}
+
+static void __chset_unlock_all(concurrent_hash_set_t *h)
+{
+	size_t i;
+	for (i = CHSET_LOCK_STRIPES; i > 0; i--) {
+		pthread_mutex_unlock(&h->locks[i - 1]);
+	}
+}
+
+/*
+ * counts the reader in the counter of the current epoch parity. if the
+ * epoch moved on before the reader was counted, it retries, so a grace
+ * period that waits for the old parity cannot miss it.
+ */
+static struct chset_reader* __chset_read_lock(concurrent_hash_set_t *h,
+		int *parity)
+{
+	if (reader_slot < 0) {
+		reader_slot = __atomic_fetch_add(&next_reader_slot, 1,
+				__ATOMIC_RELAXED) & (CHSET_READER_SLOTS - 1);
+	}
+
+	struct chset_reader *r = &h->readers[reader_slot];
+	while (1) {
+		unsigned long epoch = __atomic_load_n(&h->epoch, __ATOMIC_SEQ_CST);
+		*parity = epoch & 1;
+		__atomic_add_fetch(&r->count[*parity], 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&h->epoch, __ATOMIC_SEQ_CST) == epoch) {
+			return r;
+		}
+
+		__atomic_sub_fetch(&r->count[*parity], 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+static void __chset_read_unlock(struct chset_reader *r, int parity)
+{
+	__atomic_sub_fetch(&r->count[parity], 1, __ATOMIC_RELEASE);
+}
+
+/* queues an unlinked node, every CHSET_RETIRE_BATCH nodes are freed */
+static void __chset_retire(concurrent_hash_set_t *h, struct chain_node *n)
+{
+	vector_t batch;
+	pthread_mutex_lock(&h->retire_lock);
+	vector_push_back(&h->retired, &n);
+	if (vector_size(&h->retired) < CHSET_RETIRE_BATCH) {
+		pthread_mutex_unlock(&h->retire_lock);
+		return;
+	}
+
+	batch = h->retired;
+	VECTOR_INIT(&h->retired, sizeof(struct chain_node *));
+	pthread_mutex_unlock(&h->retire_lock);
+
+	chset_synchronize(h);
+	__chset_reclaim(h, &batch);
+	vector_destroy(&batch);
+}
+
+/* frees retired nodes, a grace period must have passed since their unlink */
+static void __chset_reclaim(concurrent_hash_set_t *h, vector_t *nodes)
+{
+	size_t i;
+	for (i = 0; i < vector_size(nodes); i++) {
+		struct chain_node *n = *(struct chain_node **)vector_at(nodes, i);
+		if (h->free != NULL) {
+			h->free(n->data);
+		}
+		free(n);
+	}
+
+	vector_clear(nodes);
+}
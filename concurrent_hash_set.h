@@ -0,0 +1,87 @@
+#ifndef _CONCURRENT_HASH_SET_H_
+#define _CONCURRENT_HASH_SET_H_
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "util_define.h"
+#include "hash_set.h"
+#include "vector.h"
+
+#define CHSET_LOCK_STRIPES	64	/* writer locks, a power of two */
+#define CHSET_READER_SLOTS	64	/* reader counters, a power of two */
+#define CHSET_RETIRE_BATCH	64	/* erased nodes freed per grace period */
+#define CHSET_INIT(h, elem_size)	chset_init((h), (elem_size), NULL, NULL, NULL)
+
+typedef struct concurrent_hash_set concurrent_hash_set_t;
+
+/* bucket array published to readers, replaced as a whole on resize */
+struct chset_table {
+	size_t bucket_size;		/* a power of two, >= CHSET_LOCK_STRIPES */
+	struct bucket buckets[0];
+};
+
+/* readers of each epoch parity, one cache line per slot */
+struct chset_reader {
+	unsigned long count[2];
+} __attribute__((aligned(64)));
+
+/*
+ * hash set safe for concurrent use. chset_find takes no lock: readers
+ * announce themselves in a reader slot and walk the chains, so unlinked
+ * nodes and old tables are freed only after every reader of the epoch
+ * they were unlinked in has left. chset_insert and chset_erase lock one
+ * of CHSET_LOCK_STRIPES mutexes picked by the low bits of the hash, a
+ * resize holds all of them while readers keep using the old table.
+ */
+struct concurrent_hash_set {
+	struct chset_table *table;
+	size_t elem_size;
+	size_t key_size;
+	size_t size;
+	unsigned long epoch;
+	pthread_mutex_t locks[CHSET_LOCK_STRIPES];
+	pthread_mutex_t sync_lock;	/* serializes grace periods */
+	pthread_mutex_t retire_lock;
+	vector_t retired;		/* erased nodes waiting for readers */
+	struct chset_reader readers[CHSET_READER_SLOTS];
+	void (*copy)(void *dest, void *src);
+	void (*free)(void *element);
+	int (*compare)(void *e1, void *e2);
+	uint64 (*hash)(const void *key, size_t length);
+};
+
+/* function prototype */
+void chset_init(concurrent_hash_set_t *h, size_t elem_size,
+		void (*copy_func)(void *, void *),
+		void (*free_func)(void *),
+		int (*cmp_func)(void *, void *));
+void chset_destroy(concurrent_hash_set_t *h);
+void chset_clear(concurrent_hash_set_t *h);
+void chset_insert(concurrent_hash_set_t *h, void *key);
+void chset_erase(concurrent_hash_set_t *h, void *key);
+int chset_find(concurrent_hash_set_t *h, void *key, void *element);
+void chset_synchronize(concurrent_hash_set_t *h);
+
+/* checks whether the hash set is empty */
+static inline int chset_empty(concurrent_hash_set_t *h)
+{
+	assert(h);
+	return !__atomic_load_n(&h->size, __ATOMIC_RELAXED);
+}
+
+/* return the number of elements */
+static inline size_t chset_size(concurrent_hash_set_t *h)
+{
+	assert(h);
+	return __atomic_load_n(&h->size, __ATOMIC_RELAXED);
+}
+
+static inline void __chset_set_key_size(concurrent_hash_set_t *h,
+		size_t key_size)
+{
+	assert(h && key_size > 0 && key_size <= h->elem_size);
+	h->key_size = key_size;
+}
+
+#endif
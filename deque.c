@@ -2,6 +2,20 @@
 
 /* function prototypes */
 static void __expand(deque_t *d);
+static void __deque_remap(deque_t *d, size_t capacity);
+static void* __block_alloc(deque_t *d);
+static struct block* __new_back_block(deque_t *d);
+static struct block* __new_front_block(deque_t *d);
+static void __drop_back_block(deque_t *d);
+static void __drop_front_block(deque_t *d);
+static void __copy_run(deque_t *d, void *dest, const void *src, size_t n);
+static void* __grow_back(deque_t *d);
+static void* __grow_front(deque_t *d);
+static void __shrink_back(deque_t *d, size_t n);
+static void __shrink_front(deque_t *d, size_t n);
+static void* __deque_slot(deque_t *d, size_t position, size_t *index);
+static void __move_elements(deque_t *d, size_t dest, size_t src, size_t n);
+static void __block_release(deque_t *d, struct block *b);
 static void __block_destroy(deque_t *d, struct block *b);
 static void __deque_iter_head(iterator_t *it, deque_t *d);
 static void __deque_iter_next(iterator_t *it, deque_t *d);
@@ -9,9 +23,20 @@ static void __deque_iter_tail(iterator_t *it, deque_t *d);
 static void __deque_iter_prev(iterator_t *it, deque_t *d);
 
 
-/* initialize deque */
+/* initialize deque, blocks are sized from DEQUE_BLOCK_BYTES */
 void deque_init(deque_t *d, size_t elem_size,
 		void (*copy_func)(void *, void *), void (*free_func)(void *))
+{
+	deque_init_block(d, elem_size, 0, copy_func, free_func);
+}
+
+/*
+ * initialize deque with block_capacity elements per block, rounded up to
+ * a power of two. 0 picks the largest power of two whose block fits in
+ * DEQUE_BLOCK_BYTES, but at least DEQUE_MIN_BLOCK_CAPACITY.
+ */
+void deque_init_block(deque_t *d, size_t elem_size, size_t block_capacity,
+		void (*copy_func)(void *, void *), void (*free_func)(void *))
 {
 	assert(d && elem_size > 0);
 
@@ -21,8 +46,19 @@ void deque_init(deque_t *d, size_t elem_size,
 	assert(d->array);
 
 	memset(d->array, 0, sizeof(struct block) * d->capacity);
-	d->each_block_capacity = DEFAULT_BLOCK_CAPACITY;
+	if (block_capacity == 0) {
+		block_capacity = DEQUE_MIN_BLOCK_CAPACITY;
+		while (block_capacity * 2 * elem_size <= DEQUE_BLOCK_BYTES) {
+			block_capacity *= 2;
+		}
+	}
+	d->each_block_capacity = 1;
+	while (d->each_block_capacity < block_capacity) {
+		d->each_block_capacity *= 2;
+		d->block_shift++;
+	}
 	d->elem_size = elem_size;
+	d->spare_limit = DEQUE_SPARE_BLOCKS;
 	d->copy = copy_func;
 	d->free = free_func;
 	d->iter_head = __deque_iter_head;
@@ -36,20 +72,17 @@ void* deque_at(deque_t *d, size_t position)
 {
 	assert(d && d->array && position < deque_size(d));
 
-	size_t block_index;
-	size_t element_index;
-	struct block *first_block = &d->array[d->begin];
-	size_t first_block_size = first_block->size;
-	if (position < first_block_size) {
-		block_index = d->begin;
-		element_index = first_block->begin + position;
-	} else {
-		size_t tmp = position - first_block_size;
-		block_index = d->begin + tmp / d->each_block_capacity + 1;
-		element_index = tmp % d->each_block_capacity;
-	}
-
-	struct block *b = &d->array[block_index % d->capacity];
+	/*
+	 * every block but the last ends at the end of its array and every
+	 * block but the first starts at 0, so the position counted from the
+	 * start of the first array splits into block and element by a shift
+	 * and a mask. the ring capacity is a power of two as well.
+	 */
+	size_t offset = d->array[d->begin].begin + position;
+	size_t block_index = d->begin + (offset >> d->block_shift);
+	size_t element_index = offset & (d->each_block_capacity - 1);
+
+	struct block *b = &d->array[block_index & (d->capacity - 1)];
 	assert(b->array && element_index <= b->end);
 
 	return (char *)b->array + element_index * d->elem_size;
@@ -82,183 +115,542 @@ void deque_push_back(deque_t *d, void *element)
 {
 	assert(d && d->array && element);
 
-	/* the block array is full, need to expand */
-	struct block *last_block = &d->array[d->end];
-	if (d->size == d->capacity &&
-			last_block->end == d->each_block_capacity - 1) {
-		__expand(d);
+	void *dest = __grow_back(d);
+	CONTAINER_COPY(dest, element, d);
+}
+
+/* removes the last element */
+void deque_pop_back(deque_t *d)
+{
+	assert(d && d->array && !deque_empty(d));
+
+	/* free the last element */
+	if (d->free != NULL) {
+		struct block *last_block = &d->array[d->end];
+		d->free((char *)last_block->array +
+				d->elem_size * last_block->end);
 	}
 
-	/* find which block to insert */
-	size_t element_index;
-	struct block *insert;
-	last_block = &d->array[d->end];
-	if (d->size == 0 || last_block->end == d->each_block_capacity - 1) {
-		if (d->size != 0) {
-			d->end = (d->end == d->capacity - 1) ? 0 : (d->end + 1);
-		} else {
-			d->end = d->begin;
-		}
+	__shrink_back(d, 1);
+}
+
+/* inserts elements to the beginging */
+void deque_push_front(deque_t *d, void *element)
+{
+	assert(d && d->array && element);
+
+	void *dest = __grow_front(d);
+	CONTAINER_COPY(dest, element, d);
+}
+
+/* removes the first element */
+void deque_pop_front(deque_t *d)
+{
+	assert(d && d->array && !deque_empty(d));
+
+	/* free the first element */
+	if (d->free != NULL) {
+		struct block *first_block = &d->array[d->begin];
+		d->free((char *)first_block->array +
+				d->elem_size * first_block->begin);
+	}
 
-		d->size++;
-		insert = &d->array[d->end];
-		insert->array = malloc(d->elem_size * d->each_block_capacity);
-		assert(insert->array);
+	__shrink_front(d, 1);
+}
+
+/*
+ * inserts element before position, moving the elements on the shorter
+ * side by one slot. position deque_size appends.
+ */
+void deque_insert(deque_t *d, size_t position, void *element)
+{
+	assert(d && d->array && element && position <= deque_size(d));
 
-		insert->begin = element_index = 0;
+	void *dest;
+	if (position < deque_size(d) / 2) {
+		__grow_front(d);
+		__move_elements(d, 0, 1, position);
+		dest = __deque_slot(d, position, NULL);
 	} else {
-		insert = last_block;
-		element_index = last_block->end + 1;
+		dest = __grow_back(d);
+		if (position < deque_size(d) - 1) {
+			__move_elements(d, position + 1, position,
+					deque_size(d) - 1 - position);
+			dest = __deque_slot(d, position, NULL);
+		}
 	}
 
-	/* copy the element to destination */
-	void *dest = (char *)insert->array + d->elem_size * element_index;
 	CONTAINER_COPY(dest, element, d);
+}
 
-	/* modify block descriptor */
-	insert->end = element_index;
-	insert->size++;
-	d->deque_size++;
+/* removes the element at position */
+void deque_erase(deque_t *d, size_t position)
+{
+	assert(d && d->array && position < deque_size(d));
+	deque_erase_range(d, position, position + 1);
 }
 
-/* removes the last element */
-void deque_pop_back(deque_t *d)
+/*
+ * removes the elements in [first, last), moving the elements on the
+ * shorter side over the gap
+ */
+void deque_erase_range(deque_t *d, size_t first, size_t last)
 {
-	assert(d && d->array && !deque_empty(d));
+	assert(d && d->array && first <= last && last <= deque_size(d));
 
-	/* find the last block */
-	struct block *last_block = &d->array[d->end];
-	assert(last_block->array && last_block->size > 0);
+	size_t n = last - first;
+	if (n == 0) {
+		return;
+	}
 
-	/* modify block descriptor */
-	if (last_block->size == 1) {
-		__block_destroy(d, last_block);
-		if (d->size != 1) {
-			d->end = (d->end == 0) ? (d->capacity - 1) : (d->end - 1);
-		} else {
-			d->end = d->begin;
+	if (d->free != NULL) {
+		size_t i;
+		for (i = first; i < last; i++) {
+			d->free(__deque_slot(d, i, NULL));
 		}
+	}
 
-		d->size--;
+	if (first < deque_size(d) - last) {
+		__move_elements(d, n, 0, first);
+		__shrink_front(d, n);
 	} else {
-		/* free the last element */
-		void *dest = (char *)last_block->array +
-			d->elem_size * last_block->end;
-		if (d->free != NULL) {
-			d->free(dest);
+		__move_elements(d, first, last, deque_size(d) - last);
+		__shrink_back(d, n);
+	}
+}
+
+/* inserts n elements to the end, copied a block sized run at a time */
+void deque_push_back_n(deque_t *d, void *elements, size_t n)
+{
+	assert(d && d->array && (elements || !n));
+
+	const char *src = elements;
+	while (n > 0) {
+		size_t index;
+		struct block *b = &d->array[d->end];
+		if (d->size == 0 || b->end == d->each_block_capacity - 1) {
+			b = __new_back_block(d);
+			b->begin = index = 0;
+		} else {
+			index = b->end + 1;
 		}
 
-		last_block->end--;
-		last_block->size--;
-	}
+		size_t run = d->each_block_capacity - index;
+		if (run > n) {
+			run = n;
+		}
 
-	d->deque_size--;
+		__copy_run(d, (char *)b->array + index * d->elem_size, src, run);
+		b->end = index + run - 1;
+		b->size += run;
+		d->deque_size += run;
+		src += run * d->elem_size;
+		n -= run;
+	}
 }
 
-/* inserts elements to the beginging */
-void deque_push_front(deque_t *d, void *element)
+/*
+ * removes up to n elements from the beginning and returns how many. if out
+ * is not NULL the elements are moved there in order and not freed.
+ */
+size_t deque_pop_front_n(deque_t *d, void *out, size_t n)
 {
-	assert(d && d->array && element);
+	assert(d && d->array);
 
-	/* the block array is full, need to expand */
-	struct block *first_block = &d->array[d->begin];
-	if (d->size == d->capacity &&
-			(first_block->size > 0 && first_block->begin == 0)) {
-		__expand(d);
+	if (n > d->deque_size) {
+		n = d->deque_size;
 	}
 
-	/* find which block to insert */
-	size_t element_index;
-	struct block *insert;
-	first_block = &d->array[d->begin];
-	if (d->size == 0 || (first_block->size > 0 && first_block->begin == 0)) {
-		if (d->size != 0) {
-			d->begin = (d->begin == 0) ? (d->capacity - 1) : (d->begin - 1);
-		} else {
-			d->begin = d->end;
+	size_t left = n;
+	char *dest = out;
+	while (left > 0) {
+		struct block *b = &d->array[d->begin];
+		size_t run = (b->size < left) ? b->size : left;
+		char *src = (char *)b->array + b->begin * d->elem_size;
+		if (dest != NULL) {
+			memcpy(dest, src, run * d->elem_size);
+			dest += run * d->elem_size;
+		} else if (d->free != NULL) {
+			size_t i;
+			for (i = 0; i < run; i++) {
+				d->free(src + i * d->elem_size);
+			}
 		}
 
-		d->size++;
-		insert = &d->array[d->begin];
-		insert->array = malloc(d->elem_size * d->each_block_capacity);
-		assert(insert->array);
-
-		/* insert to the last of the array */
-		insert->end = element_index = d->each_block_capacity - 1;
-	} else {
-		insert = first_block;
-		element_index = first_block->begin - 1;
+		b->begin += run;
+		b->size -= run;
+		d->deque_size -= run;
+		left -= run;
+		if (b->size == 0) {
+			__block_release(d, b);
+			__drop_front_block(d);
+		}
 	}
 
-	/* copy the element to destination */
-	void *dest = (char *)insert->array + d->elem_size * element_index;
-	CONTAINER_COPY(dest, element, d);
-
-	/* modify block descriptor */
-	insert->begin = element_index;
-	insert->size++;
-	d->deque_size++;
+	return n;
 }
 
-/* removes the first element */
-void deque_pop_front(deque_t *d)
+/*
+ * removes up to n elements from the end and returns how many. if out is
+ * not NULL the elements are moved there in deque order and not freed.
+ */
+size_t deque_pop_back_n(deque_t *d, void *out, size_t n)
 {
-	assert(d && d->array && !deque_empty(d));
+	assert(d && d->array);
 
-	/* find the last block */
-	struct block *first_block = &d->array[d->begin];
-	assert(first_block->array && first_block->size > 0);
+	if (n > d->deque_size) {
+		n = d->deque_size;
+	}
 
-	/* modify block descriptor */
-	if (first_block->size == 1) {
-		__block_destroy(d, first_block);
-		if (d->size != 1) {
-			d->begin = (d->begin == d->capacity - 1) ? 0 : (d->begin + 1);
-		} else {
-			d->begin = d->end;
+	/* runs are taken from the back, so out is filled from its end */
+	size_t left = n;
+	while (left > 0) {
+		struct block *b = &d->array[d->end];
+		size_t run = (b->size < left) ? b->size : left;
+		char *src = (char *)b->array + (b->end + 1 - run) * d->elem_size;
+		if (out != NULL) {
+			memcpy((char *)out + (left - run) * d->elem_size, src,
+					run * d->elem_size);
+		} else if (d->free != NULL) {
+			size_t i;
+			for (i = 0; i < run; i++) {
+				d->free(src + i * d->elem_size);
+			}
 		}
 
-		d->size--;
-	} else {
-		/* free the first element */
-		void *dest = (char *)first_block->array +
-			d->elem_size * first_block->begin;
-		if (d->free != NULL) {
-			d->free(dest);
+		b->end -= run;
+		b->size -= run;
+		d->deque_size -= run;
+		left -= run;
+		if (b->size == 0) {
+			__block_release(d, b);
+			__drop_back_block(d);
 		}
+	}
+
+	return n;
+}
+
+/*
+ * returns the next contiguous run of elements in *span and its length,
+ * or 0 after the last one. *index counts the runs handed out so far and
+ * must start at 0, the deque must not change in between.
+ */
+size_t deque_next_span(deque_t *d, size_t *index, void **span)
+{
+	assert(d && index && span);
 
-		first_block->begin++;
-		first_block->size--;
+	if (*index >= d->size) {
+		*span = NULL;
+		return 0;
 	}
 
-	d->deque_size--;
+	struct block *b = &d->array[(d->begin + *index) % d->capacity];
+	(*index)++;
+	*span = (char *)b->array + b->begin * d->elem_size;
+	return b->size;
 }
 
-/* expand the block array */
+/* calls cb with each contiguous run of elements, front to back */
+void deque_spans(deque_t *d, void (*cb)(void *span, size_t n, void *arg),
+		void *arg)
+{
+	assert(d && cb);
+
+	size_t index = 0;
+	void *span;
+	size_t n;
+	while ((n = deque_next_span(d, &index, &span)) > 0) {
+		cb(span, n, arg);
+	}
+}
+
+/* sets how many empty blocks are kept for reuse instead of freed */
+void deque_set_spare_limit(deque_t *d, size_t limit)
+{
+	assert(d);
+
+	d->spare_limit = limit;
+	while (d->spare_size > limit) {
+		void *next = *(void **)d->spare;
+		free(d->spare);
+		d->spare = next;
+		d->spare_size--;
+	}
+}
+
+/* frees the spare blocks and shrinks the block array to the blocks in use */
+void deque_shrink_to_fit(deque_t *d)
+{
+	assert(d && d->array);
+
+	__deque_free_spares(d);
+
+	size_t capacity = DEFAULT_CONTAINER_CAPACITY;
+	while (capacity < d->size) {
+		capacity *= 2;
+	}
+	if (capacity < d->capacity) {
+		__deque_remap(d, capacity);
+	}
+}
+
+/*
+ * expand the block array. the blocks form a ring, so this only happens
+ * when every slot holds a block and there is nothing to recentre
+ */
 static void __expand(deque_t *d)
 {
-	size_t old_capacity = d->capacity;
-	d->capacity *= 2;
-	struct block *new_array = malloc(sizeof(struct block) * d->capacity);
+	__deque_remap(d, d->capacity * 2);
+}
+
+/* moves the blocks to the start of a new array of capacity slots */
+static void __deque_remap(deque_t *d, size_t capacity)
+{
+	assert(capacity >= d->size);
+
+	struct block *new_array = malloc(sizeof(struct block) * capacity);
 	assert(new_array);
 
-	memset(new_array, 0, sizeof(struct block) * d->capacity);
+	memset(new_array, 0, sizeof(struct block) * capacity);
 	/* copy blocks in old array to new array */
 	size_t i;
-	size_t array_end = (d->end < d->begin) ? (old_capacity + d->end) : d->end;
-	for (i = d->begin; i <= array_end; i++) {
-		struct block *old_block = &d->array[i % old_capacity];
-		struct block *new_block = &new_array[i - d->begin];
-		memcpy(new_block, old_block, sizeof(struct block));
+	for (i = 0; i < d->size; i++) {
+		struct block *old_block = &d->array[(d->begin + i) % d->capacity];
+		memcpy(&new_array[i], old_block, sizeof(struct block));
 	}
 
+	d->capacity = capacity;
 	d->begin = 0;
-	d->end = d->size - 1;
+	d->end = (d->size > 0) ? d->size - 1 : 0;
 	free(d->array);
 	d->array = new_array;
 }
 
-/* destroy the block, free the memory */
+/* appends an empty block to the ring, expanding it when full */
+static struct block* __new_back_block(deque_t *d)
+{
+	if (d->size == d->capacity) {
+		__expand(d);
+	}
+
+	if (d->size != 0) {
+		d->end = (d->end == d->capacity - 1) ? 0 : (d->end + 1);
+	} else {
+		d->end = d->begin;
+	}
+
+	d->size++;
+	struct block *b = &d->array[d->end];
+	b->array = __block_alloc(d);
+	return b;
+}
+
+/* prepends an empty block to the ring, expanding it when full */
+static struct block* __new_front_block(deque_t *d)
+{
+	if (d->size == d->capacity) {
+		__expand(d);
+	}
+
+	if (d->size != 0) {
+		d->begin = (d->begin == 0) ? (d->capacity - 1) : (d->begin - 1);
+	} else {
+		d->begin = d->end;
+	}
+
+	d->size++;
+	struct block *b = &d->array[d->begin];
+	b->array = __block_alloc(d);
+	return b;
+}
+
+/* removes the released last block from the ring */
+static void __drop_back_block(deque_t *d)
+{
+	if (d->size != 1) {
+		d->end = (d->end == 0) ? (d->capacity - 1) : (d->end - 1);
+	} else {
+		d->end = d->begin;
+	}
+
+	d->size--;
+}
+
+/* removes the released first block from the ring */
+static void __drop_front_block(deque_t *d)
+{
+	if (d->size != 1) {
+		d->begin = (d->begin == d->capacity - 1) ? 0 : (d->begin + 1);
+	} else {
+		d->begin = d->end;
+	}
+
+	d->size--;
+}
+
+/* copies n elements, with one memcpy if there is no copy function */
+static void __copy_run(deque_t *d, void *dest, const void *src, size_t n)
+{
+	if (d->copy == NULL) {
+		memcpy(dest, src, n * d->elem_size);
+		return;
+	}
+
+	size_t i;
+	for (i = 0; i < n; i++) {
+		d->copy((char *)dest + i * d->elem_size,
+				(char *)src + i * d->elem_size);
+	}
+}
+
+/* adds an uninitialized slot at the end and returns it */
+static void* __grow_back(deque_t *d)
+{
+	size_t element_index;
+	struct block *b = &d->array[d->end];
+	if (d->size == 0 || b->end == d->each_block_capacity - 1) {
+		b = __new_back_block(d);
+		b->begin = element_index = 0;
+	} else {
+		element_index = b->end + 1;
+	}
+
+	b->end = element_index;
+	b->size++;
+	d->deque_size++;
+	return (char *)b->array + d->elem_size * element_index;
+}
+
+/* adds an uninitialized slot at the beginning and returns it */
+static void* __grow_front(deque_t *d)
+{
+	size_t element_index;
+	struct block *b = &d->array[d->begin];
+	if (d->size == 0 || (b->size > 0 && b->begin == 0)) {
+		b = __new_front_block(d);
+
+		/* insert to the last of the array */
+		b->end = element_index = d->each_block_capacity - 1;
+	} else {
+		element_index = b->begin - 1;
+	}
+
+	b->begin = element_index;
+	b->size++;
+	d->deque_size++;
+	return (char *)b->array + d->elem_size * element_index;
+}
+
+/* drops the last n slots without freeing them, releasing emptied blocks */
+static void __shrink_back(deque_t *d, size_t n)
+{
+	assert(n <= d->deque_size);
+
+	while (n > 0) {
+		struct block *b = &d->array[d->end];
+		size_t run = (b->size < n) ? b->size : n;
+		b->end -= run;
+		b->size -= run;
+		d->deque_size -= run;
+		n -= run;
+		if (b->size == 0) {
+			__block_release(d, b);
+			__drop_back_block(d);
+		}
+	}
+}
+
+/* drops the first n slots without freeing them, releasing emptied blocks */
+static void __shrink_front(deque_t *d, size_t n)
+{
+	assert(n <= d->deque_size);
+
+	while (n > 0) {
+		struct block *b = &d->array[d->begin];
+		size_t run = (b->size < n) ? b->size : n;
+		b->begin += run;
+		b->size -= run;
+		d->deque_size -= run;
+		n -= run;
+		if (b->size == 0) {
+			__block_release(d, b);
+			__drop_front_block(d);
+		}
+	}
+}
+
+/*
+ * returns the slot of position as deque_at does, *index gets its index in
+ * the block array if not NULL
+ */
+static void* __deque_slot(deque_t *d, size_t position, size_t *index)
+{
+	size_t offset = d->array[d->begin].begin + position;
+	size_t element_index = offset & (d->each_block_capacity - 1);
+	struct block *b = &d->array[(d->begin + (offset >> d->block_shift)) &
+		(d->capacity - 1)];
+	if (index != NULL) {
+		*index = element_index;
+	}
+
+	return (char *)b->array + element_index * d->elem_size;
+}
+
+/*
+ * moves n elements from position src to position dest a contiguous run
+ * at a time, the ranges may overlap
+ */
+static void __move_elements(deque_t *d, size_t dest, size_t src, size_t n)
+{
+	size_t cap = d->each_block_capacity;
+	size_t i, j, run;
+	if (dest < src) {
+		while (n > 0) {
+			char *to = __deque_slot(d, dest, &i);
+			char *from = __deque_slot(d, src, &j);
+			run = cap - ((i > j) ? i : j);
+			if (run > n) {
+				run = n;
+			}
+			memmove(to, from, run * d->elem_size);
+			dest += run;
+			src += run;
+			n -= run;
+		}
+	} else if (dest > src) {
+		/* back to front, each run ends at the current last element */
+		while (n > 0) {
+			__deque_slot(d, dest + n - 1, &i);
+			__deque_slot(d, src + n - 1, &j);
+			run = ((i < j) ? i : j) + 1;
+			if (run > n) {
+				run = n;
+			}
+			n -= run;
+			memmove(__deque_slot(d, dest + n, NULL),
+					__deque_slot(d, src + n, NULL),
+					run * d->elem_size);
+		}
+	}
+}
+
+/* takes a spare block or allocates one */
+static void* __block_alloc(deque_t *d)
+{
+	void *array = d->spare;
+	if (array != NULL) {
+		d->spare = *(void **)array;
+		d->spare_size--;
+		return array;
+	}
+
+	array = malloc(d->elem_size * d->each_block_capacity);
+	assert(array);
+	return array;
+}
+
+/* destroy the block, free its elements and release its memory */
 static void __block_destroy(deque_t *d, struct block *b)
 {
 	assert(b);
@@ -269,30 +661,64 @@ static void __block_destroy(deque_t *d, struct block *b)
 				d->free((char *)b->array + i * d->elem_size);
 			}
 		}
+	}
+
+	__block_release(d, b);
+}
 
-		free(b->array);
+/* frees the block memory or keeps it as a spare block up to the limit */
+static void __block_release(deque_t *d, struct block *b)
+{
+	if (b->array != NULL) {
+		if (d->spare_size < d->spare_limit &&
+				d->elem_size * d->each_block_capacity >= sizeof(void *)) {
+			*(void **)b->array = d->spare;
+			d->spare = b->array;
+			d->spare_size++;
+		} else {
+			free(b->array);
+		}
 	}
 
 	memset(b, 0, sizeof(struct block));
 }
 
-/* iterator head function for deque */
+/* iterator head function for deque, bkt_index is the ring slot of the block */
 static void __deque_iter_head(iterator_t *it, deque_t *d)
 {
 	assert(it && d);
 
-	it->ptr = (!deque_empty(d)) ? deque_front(d) : NULL;
-	it->data = it->ptr;
 	it->i = 0;
 	it->size = deque_size(d);
+	if (!deque_empty(d)) {
+		struct block *b = &d->array[d->begin];
+		it->bkt_index = d->begin;
+		it->ptr = (char *)b->array + b->begin * d->elem_size;
+	} else {
+		it->ptr = NULL;
+	}
+	it->data = it->ptr;
 }
 
-/* iterator next function for deque */
+/* iterator next function for deque, steps a pointer within each block */
 static void __deque_iter_next(iterator_t *it, deque_t *d)
 {
 	assert(it && d);
 
-	it->ptr = (++(it->i) < it->size) ? deque_at(d, it->i) : NULL;
+	if (++(it->i) >= it->size) {
+		it->ptr = it->data = NULL;
+		return;
+	}
+
+	struct block *b = &d->array[it->bkt_index];
+	if (it->ptr != (char *)b->array + b->end * d->elem_size) {
+		it->ptr = (char *)it->ptr + d->elem_size;
+	} else {
+		it->bkt_index = (it->bkt_index == d->capacity - 1) ?
+			0 : (it->bkt_index + 1);
+		b = &d->array[it->bkt_index];
+		it->ptr = (char *)b->array + b->begin * d->elem_size;
+	}
 	it->data = it->ptr;
 }
 
@@ -301,10 +727,16 @@ static void __deque_iter_tail(iterator_t *it, deque_t *d)
 {
 	assert(it && d);
 
-	it->ptr = (!deque_empty(d)) ? deque_back(d) : NULL;
-	it->data = it->ptr;
 	it->i = 0;
 	it->size = deque_size(d);
+	if (!deque_empty(d)) {
+		struct block *b = &d->array[d->end];
+		it->bkt_index = d->end;
+		it->ptr = (char *)b->array + b->end * d->elem_size;
+	} else {
+		it->ptr = NULL;
+	}
+	it->data = it->ptr;
 }
 
 /* iterator previous function for deque */
@@ -312,7 +744,19 @@ static void __deque_iter_prev(iterator_t *it, deque_t *d)
 {
 	assert(it && d);
 
-	it->ptr = (++(it->i) < it->size) ?
-		deque_at(d, it->size - it->i - 1) : NULL;
+	if (++(it->i) >= it->size) {
+		it->ptr = it->data = NULL;
+		return;
+	}
+
+	struct block *b = &d->array[it->bkt_index];
+	if (it->ptr != (char *)b->array + b->begin * d->elem_size) {
+		it->ptr = (char *)it->ptr - d->elem_size;
+	} else {
+		it->bkt_index = (it->bkt_index == 0) ?
+			(d->capacity - 1) : (it->bkt_index - 1);
+		b = &d->array[it->bkt_index];
+		it->ptr = (char *)b->array + b->end * d->elem_size;
+	}
 	it->data = it->ptr;
 }
@@ -6,7 +6,9 @@
 #include "util_define.h"
 #include "iterator.h"
 
-#define DEFAULT_BLOCK_CAPACITY	512
+#define DEQUE_BLOCK_BYTES	4096	/* target size of a block */
+#define DEQUE_MIN_BLOCK_CAPACITY	16
+#define DEQUE_SPARE_BLOCKS	2	/* default limit of cached empty blocks */
 #define DEQUE_INIT(d, elem_size)	deque_init((d), (elem_size), NULL, NULL)
 
 typedef struct deque deque_t;
@@ -20,13 +22,17 @@ struct block {
 
 struct deque {
 	struct block *array;
-	size_t each_block_capacity;
+	size_t each_block_capacity;	/* a power of two */
+	unsigned int block_shift;	/* log2(each_block_capacity) */
 	size_t capacity;
 	size_t size;
 	size_t begin;
 	size_t end;
 	size_t deque_size;
 	size_t elem_size;
+	void *spare;		/* list of empty blocks kept for reuse */
+	size_t spare_size;
+	size_t spare_limit;
 	void (*copy)(void *dest, void *src);
 	void (*free)(void *element);
 	void (*iter_head)(iterator_t *it, deque_t *d);
@@ -37,18 +43,43 @@ struct deque {
 
 void deque_init(deque_t *d, size_t elem_size,
 		void (*copy_func)(void *, void *), void (*free_func)(void *));
+void deque_init_block(deque_t *d, size_t elem_size, size_t block_capacity,
+		void (*copy_func)(void *, void *), void (*free_func)(void *));
 void* deque_at(deque_t *d, size_t position);
 void deque_clear(deque_t *d);
 void deque_push_back(deque_t *d, void *element);
 void deque_pop_back(deque_t *d);
 void deque_push_front(deque_t *d, void *element);
 void deque_pop_front(deque_t *d);
+void deque_insert(deque_t *d, size_t position, void *element);
+void deque_erase(deque_t *d, size_t position);
+void deque_erase_range(deque_t *d, size_t first, size_t last);
+void deque_push_back_n(deque_t *d, void *elements, size_t n);
+size_t deque_pop_front_n(deque_t *d, void *out, size_t n);
+size_t deque_pop_back_n(deque_t *d, void *out, size_t n);
+size_t deque_next_span(deque_t *d, size_t *index, void **span);
+void deque_spans(deque_t *d, void (*cb)(void *span, size_t n, void *arg),
+		void *arg);
+void deque_set_spare_limit(deque_t *d, size_t limit);
+void deque_shrink_to_fit(deque_t *d);
+
+/* frees the cached empty blocks, each links the next by its first bytes */
+static inline void __deque_free_spares(deque_t *d)
+{
+	while (d->spare != NULL) {
+		void *next = *(void **)d->spare;
+		free(d->spare);
+		d->spare = next;
+	}
+	d->spare_size = 0;
+}
 
 /* destroy deque, free memory */
 static inline void deque_destroy(deque_t *d)
 {
 	assert(d);
 	deque_clear(d);
+	__deque_free_spares(d);
 	free(d->array);
 	d->array = NULL;
 	d->capacity = 0;
@@ -0,0 +1,321 @@
+#include "flat_hash_set.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define FHSET_NOT_FOUND	((size_t)-1)
+#define H1(hashval)	((size_t)((hashval) >> 7))	/* selects the group */
+#define H2(hashval)	((uint8)((hashval) & 0x7f))	/* stored in ctrl */
+
+/* function prototypes */
+static size_t __fhset_find_slot(flat_hash_set_t *h, void *key, uint64 hashval);
+static size_t __fhset_find_free(flat_hash_set_t *h, uint64 hashval);
+static size_t __fhset_next_full(flat_hash_set_t *h, size_t index);
+static void __fhset_resize(flat_hash_set_t *h, size_t capacity);
+static void __fhset_iter_head(iterator_t *it, flat_hash_set_t *h);
+static void __fhset_iter_next(iterator_t *it, flat_hash_set_t *h);
+
+/* bit i is set when control byte i of the group equals c */
+static inline unsigned int __group_match(const uint8 *g, uint8 c)
+{
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)g);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)c)));
+#else
+	unsigned int mask = 0;
+	int i;
+	for (i = 0; i < FHSET_GROUP_WIDTH; i++) {
+		mask |= (unsigned int)(g[i] == c) << i;
+	}
+	return mask;
+#endif
+}
+
+/* bit i is set when slot i of the group is empty or deleted */
+static inline unsigned int __group_match_free(const uint8 *g)
+{
+#ifdef __SSE2__
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g));
+#else
+	unsigned int mask = 0;
+	int i;
+	for (i = 0; i < FHSET_GROUP_WIDTH; i++) {
+		mask |= (unsigned int)(g[i] >> 7) << i;
+	}
+	return mask;
+#endif
+}
+
+static inline void* __fhset_slot(flat_hash_set_t *h, size_t index)
+{
+	return h->slots + index * h->elem_size;
+}
+
+static inline int __fhset_equals(flat_hash_set_t *h, void *e1, void *e2)
+{
+	return (h->compare) ? !h->compare(e1, e2) : !memcmp(e1, e2, h->key_size);
+}
+
+/* initialize the hash set, slots are allocated by the first insertion */
+void fhset_init(flat_hash_set_t *h, size_t elem_size,
+		void (*copy_func)(void *, void *),
+		void (*free_func)(void *),
+		int (*cmp_func)(void *, void *))
+{
+	assert(h && elem_size > 0);
+
+	memset(h, 0, sizeof(flat_hash_set_t));
+	h->elem_size = elem_size;
+	h->key_size = elem_size;
+	h->copy = copy_func;
+	h->free = free_func;
+	h->compare = cmp_func;
+	h->hash = hash64;
+	h->iter_head = __fhset_iter_head;
+	h->iter_next = __fhset_iter_next;
+}
+
+/* destroy the hash set */
+void fhset_destroy(flat_hash_set_t *h)
+{
+	assert(h);
+
+	fhset_clear(h);
+	free(h->ctrl);
+	h->ctrl = NULL;
+	h->slots = NULL;
+	h->capacity = 0;
+	h->growth_left = 0;
+}
+
+/* remove all elements */
+void fhset_clear(flat_hash_set_t *h)
+{
+	assert(h);
+
+	if (h->capacity == 0) {
+		return;
+	}
+
+	if (h->free != NULL) {
+		size_t i;
+		for (i = __fhset_next_full(h, 0); i < h->capacity;
+				i = __fhset_next_full(h, i + 1)) {
+			h->free(__fhset_slot(h, i));
+		}
+	}
+
+	memset(h->ctrl, FHSET_CTRL_EMPTY, h->capacity);
+	h->size = 0;
+	h->growth_left = h->capacity / 8 * 7;
+}
+
+/* inserts elements */
+void fhset_insert(flat_hash_set_t *h, void *key)
+{
+	assert(h && key);
+
+	uint64 hashval = h->hash(key, h->key_size);
+	if (h->capacity > 0 &&
+			__fhset_find_slot(h, key, hashval) != FHSET_NOT_FOUND) {
+		return;
+	}
+
+	if (h->growth_left == 0) {
+		/* mostly tombstones, rehash at the same size */
+		if (h->capacity > 0 && h->size < h->capacity / 16 * 7) {
+			__fhset_resize(h, h->capacity);
+		} else {
+			__fhset_resize(h, h->capacity ?
+					h->capacity * 2 : DEFAULT_CONTAINER_CAPACITY);
+		}
+	}
+
+	size_t index = __fhset_find_free(h, hashval);
+	if (h->ctrl[index] == FHSET_CTRL_EMPTY) {
+		h->growth_left--;
+	}
+
+	h->ctrl[index] = H2(hashval);
+	CONTAINER_COPY(__fhset_slot(h, index), key, h);
+	h->size++;
+}
+
+/* erases elements */
+void fhset_erase(flat_hash_set_t *h, void *key)
+{
+	assert(h && key);
+
+	if (h->capacity == 0) {
+		return;
+	}
+
+	size_t index = __fhset_find_slot(h, key,
+			h->hash(key, h->key_size));
+	if (index == FHSET_NOT_FOUND) {
+		return;
+	}
+
+	if (h->free != NULL) {
+		h->free(__fhset_slot(h, index));
+	}
+
+	/*
+	 * probing stops at a group with an empty slot, if this group has one
+	 * the slot can become empty again, else it must stay a tombstone
+	 */
+	uint8 *g = h->ctrl + index / FHSET_GROUP_WIDTH * FHSET_GROUP_WIDTH;
+	if (__group_match(g, FHSET_CTRL_EMPTY)) {
+		h->ctrl[index] = FHSET_CTRL_EMPTY;
+		h->growth_left++;
+	} else {
+		h->ctrl[index] = FHSET_CTRL_DELETED;
+	}
+	h->size--;
+}
+
+/* finds element with specific key */
+void fhset_find(flat_hash_set_t *h, void *key, iterator_t *it)
+{
+	assert(h && key && it);
+
+	it->ptr = NULL;
+	if (h->capacity == 0) {
+		return;
+	}
+
+	size_t index = __fhset_find_slot(h, key,
+			h->hash(key, h->key_size));
+	if (index != FHSET_NOT_FOUND) {
+		it->ptr = __fhset_slot(h, index);
+		it->data = it->ptr;
+		it->key = it->data;
+		it->bkt_index = index;
+	}
+}
+
+/* probes groups in triangular order, which visits every group once */
+static size_t __fhset_find_slot(flat_hash_set_t *h, void *key, uint64 hashval)
+{
+	size_t group_mask = h->capacity / FHSET_GROUP_WIDTH - 1;
+	size_t g = H1(hashval) & group_mask;
+	size_t step = 0;
+
+	while (1) {
+		const uint8 *ctrl = h->ctrl + g * FHSET_GROUP_WIDTH;
+		unsigned int m = __group_match(ctrl, H2(hashval));
+		while (m) {
+			size_t index = g * FHSET_GROUP_WIDTH + __builtin_ctz(m);
+			if (__fhset_equals(h, key, __fhset_slot(h, index))) {
+				return index;
+			}
+			m &= m - 1;
+		}
+
+		if (__group_match(ctrl, FHSET_CTRL_EMPTY)) {
+			return FHSET_NOT_FOUND;
+		}
+
+		g = (g + ++step) & group_mask;
+	}
+}
+
+/* first empty or deleted slot on the probe sequence */
+static size_t __fhset_find_free(flat_hash_set_t *h, uint64 hashval)
+{
+	size_t group_mask = h->capacity / FHSET_GROUP_WIDTH - 1;
+	size_t g = H1(hashval) & group_mask;
+	size_t step = 0;
+
+	while (1) {
+		unsigned int m = __group_match_free(h->ctrl + g * FHSET_GROUP_WIDTH);
+		if (m) {
+			return g * FHSET_GROUP_WIDTH + __builtin_ctz(m);
+		}
+
+		g = (g + ++step) & group_mask;
+	}
+}
+
+/* index of the first full slot at or after index, capacity if none */
+static size_t __fhset_next_full(flat_hash_set_t *h, size_t index)
+{
+	while (index < h->capacity) {
+		size_t g = index / FHSET_GROUP_WIDTH * FHSET_GROUP_WIDTH;
+		unsigned int m = ~__group_match_free(h->ctrl + g) & 0xffff;
+		m &= ~0u << (index - g);
+		if (m) {
+			return g + __builtin_ctz(m);
+		}
+		index = g + FHSET_GROUP_WIDTH;
+	}
+
+	return h->capacity;
+}
+
+/* moves all elements to a table of capacity slots, drops the tombstones */
+static void __fhset_resize(flat_hash_set_t *h, size_t capacity)
+{
+	assert(h && capacity % FHSET_GROUP_WIDTH == 0 &&
+			!(capacity & (capacity - 1)));
+
+	uint8 *old_ctrl = h->ctrl;
+	char *old_slots = h->slots;
+	size_t old_capacity = h->capacity;
+
+	h->ctrl = malloc(capacity + capacity * h->elem_size);
+	assert(h->ctrl);
+	h->slots = (char *)h->ctrl + capacity;
+	h->capacity = capacity;
+	memset(h->ctrl, FHSET_CTRL_EMPTY, capacity);
+
+	size_t i;
+	for (i = 0; i < old_capacity; i++) {
+		if (old_ctrl[i] & 0x80) {
+			continue;
+		}
+
+		void *element = old_slots + i * h->elem_size;
+		uint64 hashval = h->hash(element, h->key_size);
+		size_t index = __fhset_find_free(h, hashval);
+		h->ctrl[index] = H2(hashval);
+		memcpy(__fhset_slot(h, index), element, h->elem_size);
+	}
+
+	h->growth_left = capacity / 8 * 7 - h->size;
+	free(old_ctrl);
+}
+
+static void __fhset_iter_head(iterator_t *it, flat_hash_set_t *h)
+{
+	assert(it && h);
+
+	memset(it, 0, sizeof(iterator_t));
+	if (!fhset_empty(h)) {
+		size_t index = __fhset_next_full(h, 0);
+		it->ptr = __fhset_slot(h, index);
+		it->data = it->ptr;
+		it->key = it->data;
+		it->bkt_index = index;
+		it->i = 0;
+		it->size = fhset_size(h);
+	} else {
+		it->ptr = NULL;
+	}
+}
+
+static void __fhset_iter_next(iterator_t *it, flat_hash_set_t *h)
+{
+	assert(it && h && it->ptr);
+
+	size_t index = __fhset_next_full(h, it->bkt_index + 1);
+	if (index < h->capacity) {
+		it->ptr = __fhset_slot(h, index);
+		it->data = it->ptr;
+		it->key = it->data;
+		it->bkt_index = index;
+		it->i++;
+	} else {
+		it->ptr = NULL;
+	}
+}
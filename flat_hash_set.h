@@ -0,0 +1,80 @@
+#ifndef _FLAT_HASH_SET_H_
+#define _FLAT_HASH_SET_H_
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util_define.h"
+#include "iterator.h"
+#include "hash.h"
+
+#define FHSET_GROUP_WIDTH	16
+#define FHSET_INIT(h, elem_size)	fhset_init((h), (elem_size), NULL, NULL, NULL)
+
+/* control byte of a slot, a full slot holds the low 7 bits of the hash */
+#define FHSET_CTRL_EMPTY	((uint8)0x80)
+#define FHSET_CTRL_DELETED	((uint8)0xfe)
+
+typedef struct flat_hash_set flat_hash_set_t;
+
+/*
+ * open addressing hash set, elements are stored inline in a flat slot
+ * array and probed a group of 16 control bytes at a time. unlike hash_set_t
+ * elements move when the table grows, so pointers into the set are only
+ * valid until the next insertion.
+ */
+struct flat_hash_set {
+	uint8 *ctrl;
+	char *slots;
+	size_t capacity;
+	size_t size;
+	size_t growth_left;
+	size_t elem_size;
+	size_t key_size;
+	void (*copy)(void *dest, void *src);
+	void (*free)(void *element);
+	int (*compare)(void *e1, void *e2);
+	uint64 (*hash)(const void *key, size_t length);
+	void (*iter_head)(iterator_t *it, flat_hash_set_t *h);
+	void (*iter_next)(iterator_t *it, flat_hash_set_t *h);
+};
+
+/* function prototype */
+void fhset_init(flat_hash_set_t *h, size_t elem_size,
+		void (*copy_func)(void *, void *),
+		void (*free_func)(void *),
+		int (*cmp_func)(void *, void *));
+void fhset_destroy(flat_hash_set_t *h);
+void fhset_clear(flat_hash_set_t *h);
+void fhset_insert(flat_hash_set_t *h, void *key);
+void fhset_erase(flat_hash_set_t *h, void *key);
+void fhset_find(flat_hash_set_t *h, void *key, iterator_t *it);
+
+/* checks whether the hash set is empty */
+static inline int fhset_empty(flat_hash_set_t *h)
+{
+	assert(h);
+	return !h->size;
+}
+
+/* return the number of elements */
+static inline size_t fhset_size(flat_hash_set_t *h)
+{
+	assert(h);
+	return h->size;
+}
+
+/* replaces the hash function (hash64 by default), the set must be empty */
+static inline void fhset_set_hash(flat_hash_set_t *h,
+		uint64 (*hash_func)(const void *, size_t))
+{
+	assert(h && hash_func && !h->size);
+	h->hash = hash_func;
+}
+
+static inline void __fhset_set_key_size(flat_hash_set_t *h, size_t key_size)
+{
+	assert(h && key_size > 0 && key_size <= h->elem_size);
+	h->key_size = key_size;
+}
+
+#endif
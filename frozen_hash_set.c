@@ -0,0 +1,341 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "frozen_hash_set.h"
+
+#define FZSET_FILE_MAGIC	"CUTILHSX"
+#define FZSET_FILE_VERSION	1
+
+/* header of a frozen hash set, the offsets and the records follow it */
+struct fzset_file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t elem_size;
+	uint64_t key_size;
+	uint64_t size;
+	uint64_t bucket_size;
+	uint64_t records_size;		/* bytes of records */
+	char reserved[8];
+};
+
+/* function prototypes */
+static size_t __fzset_record_size(size_t key_size, size_t elem_size,
+		const void *data);
+static int __fzset_check_offsets(frozen_hash_set_t *f, uint64 records_size);
+static int __fzset_record_fits(frozen_hash_set_t *f, const char *r,
+		const char *end);
+static void __fzset_iter_head(iterator_t *it, frozen_hash_set_t *f);
+static void __fzset_iter_next(iterator_t *it, frozen_hash_set_t *f);
+
+/*
+ * writes the hash set to path as a frozen hash set with about one record
+ * per bucket. the elements must be plain data compared by memcmp.
+ */
+int hset_freeze(hash_set_t *h, const char *path)
+{
+	assert(h && path && h->copy == NULL && h->free == NULL &&
+			h->compare == NULL);
+
+	size_t bucket_size = 1;
+	while (bucket_size < h->size) {
+		bucket_size *= 2;
+	}
+
+	/* bytes of each bucket, then prefix sums as record offsets */
+	uint64 *offsets = calloc(bucket_size + 1, sizeof(uint64));
+	if (offsets == NULL) {
+		return -1;
+	}
+
+	iterator_t it;
+	UTIL_FOREACH(it, h) {
+		struct chain_node *n = it.ptr;
+		offsets[(n->hash & (bucket_size - 1)) + 1] +=
+			__fzset_record_size(h->key_size, h->elem_size, n->data);
+	}
+
+	size_t i;
+	for (i = 0; i < bucket_size; i++) {
+		offsets[i + 1] += offsets[i];
+	}
+
+	struct fzset_file_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FZSET_FILE_MAGIC, sizeof(header.magic));
+	header.version = FZSET_FILE_VERSION;
+	header.header_size = sizeof(header);
+	header.elem_size = h->elem_size;
+	header.key_size = h->key_size;
+	header.size = h->size;
+	header.bucket_size = bucket_size;
+	header.records_size = offsets[bucket_size];
+
+	size_t offsets_size = sizeof(uint64) * (bucket_size + 1);
+	size_t length = sizeof(header) + offsets_size + header.records_size;
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		free(offsets);
+		return -1;
+	}
+
+	/* records are written in place through a mapping of the file */
+	char *base = MAP_FAILED;
+	if (ftruncate(fd, length) == 0) {
+		base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+				fd, 0);
+	}
+	if (base == MAP_FAILED) {
+		close(fd);
+		free(offsets);
+		return -1;
+	}
+
+	memcpy(base, &header, sizeof(header));
+	memcpy(base + sizeof(header), offsets, offsets_size);
+	char *records = base + sizeof(header) + offsets_size;
+	UTIL_FOREACH(it, h) {
+		struct chain_node *n = it.ptr;
+		size_t size = __fzset_record_size(h->key_size, h->elem_size,
+				n->data);
+		uint64 *cursor = &offsets[n->hash & (bucket_size - 1)];
+		size_t data_size = h->key_size ? h->elem_size :
+			sizeof(struct bytes_key) +
+			((struct bytes_key *)n->data)->length + 1;
+		memcpy(records + *cursor, &n->hash, sizeof(uint64));
+		memcpy(records + *cursor + sizeof(uint64), n->data, data_size);
+		*cursor += size;
+	}
+
+	int ret = 0;
+	if (munmap(base, length) != 0 || close(fd) != 0) {
+		ret = -1;
+	}
+	free(offsets);
+	return ret;
+}
+
+/* maps a file written by hset_freeze, hash_func NULL means hash64 */
+int fzset_map(frozen_hash_set_t *f, const char *path,
+		uint64 (*hash_func)(const void *, size_t))
+{
+	assert(f && path);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct stat st;
+	struct fzset_file_header header;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(header) ||
+			pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+		close(fd);
+		return -1;
+	}
+
+	/* sizes are bounded by the file before they are multiplied or added */
+	size_t body_size = (size_t)st.st_size - sizeof(header);
+	if (memcmp(header.magic, FZSET_FILE_MAGIC, sizeof(header.magic)) ||
+			header.version != FZSET_FILE_VERSION ||
+			header.header_size != sizeof(header) ||
+			header.elem_size == 0 ||
+			header.key_size > header.elem_size ||
+			header.bucket_size == 0 ||
+			(header.bucket_size & (header.bucket_size - 1)) ||
+			header.bucket_size >= body_size / sizeof(uint64) ||
+			header.records_size != body_size -
+			sizeof(uint64) * (header.bucket_size + 1)) {
+		close(fd);
+		return -1;
+	}
+
+	char *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		return -1;
+	}
+
+	memset(f, 0, sizeof(frozen_hash_set_t));
+	f->base = base;
+	f->length = st.st_size;
+	f->offsets = (const uint64 *)(base + sizeof(header));
+	f->records = (const char *)(f->offsets + header.bucket_size + 1);
+	f->bucket_size = header.bucket_size;
+	f->size = header.size;
+	f->elem_size = header.elem_size;
+	f->key_size = header.key_size;
+	f->hash = (hash_func != NULL) ? hash_func : hash64;
+	f->iter_head = __fzset_iter_head;
+	f->iter_next = __fzset_iter_next;
+
+	if (__fzset_check_offsets(f, header.records_size) != 0) {
+		fzset_unmap(f);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* unmaps the file */
+void fzset_unmap(frozen_hash_set_t *f)
+{
+	assert(f);
+
+	if (f->base != NULL) {
+		munmap(f->base, f->length);
+	}
+	memset(f, 0, sizeof(frozen_hash_set_t));
+}
+
+/* finds element with specific key */
+void fzset_find(frozen_hash_set_t *f, void *key, iterator_t *it)
+{
+	assert(f && key && it && f->key_size);
+
+	uint64 hashval = f->hash(key, f->key_size);
+	size_t b = hashval & (f->bucket_size - 1);
+	size_t size = __fzset_record_size(f->key_size, f->elem_size, NULL);
+	const char *r = f->records + f->offsets[b];
+	const char *end = f->records + f->offsets[b + 1];
+
+	it->ptr = NULL;
+	for (; r < end; r += size) {
+		if (*(const uint64 *)r == hashval &&
+				!memcmp(r + sizeof(uint64), key, f->key_size)) {
+			it->ptr = (void *)r;
+			it->data = (void *)(r + sizeof(uint64));
+			it->key = it->data;
+			return;
+		}
+	}
+}
+
+/* finds a variable length key, it->data is its struct bytes_key */
+void fzset_find_bytes(frozen_hash_set_t *f, const void *bytes, size_t length,
+		iterator_t *it)
+{
+	assert(f && (bytes || !length) && it && !f->key_size);
+
+	uint64 hashval = f->hash(bytes, length);
+	size_t b = hashval & (f->bucket_size - 1);
+	const char *r = f->records + f->offsets[b];
+	const char *end = f->records + f->offsets[b + 1];
+
+	it->ptr = NULL;
+	while (r < end && __fzset_record_fits(f, r, end)) {
+		const struct bytes_key *k =
+			(const struct bytes_key *)(r + sizeof(uint64));
+		if (*(const uint64 *)r == hashval && k->length == length &&
+				!memcmp(k->bytes, bytes, length)) {
+			it->ptr = (void *)r;
+			it->data = (void *)k;
+			it->key = it->data;
+			return;
+		}
+		r += __fzset_record_size(0, 0, k);
+	}
+}
+
+/*
+ * checks that the record offsets start at 0, never decrease, are 8 byte
+ * aligned and end at records_size, so every bucket lies inside the
+ * mapping. with fixed size keys each bucket and the element count must
+ * also match whole records.
+ */
+static int __fzset_check_offsets(frozen_hash_set_t *f, uint64 records_size)
+{
+	const uint64 *offsets = f->offsets;
+	size_t record = f->key_size ?
+		__fzset_record_size(f->key_size, f->elem_size, NULL) : 0;
+	if (offsets[0] != 0 || offsets[f->bucket_size] != records_size) {
+		return -1;
+	}
+
+	size_t i;
+	for (i = 0; i < f->bucket_size; i++) {
+		if (offsets[i] > offsets[i + 1] ||
+				(offsets[i + 1] & (sizeof(uint64) - 1)) ||
+				(record && (offsets[i + 1] - offsets[i]) % record)) {
+			return -1;
+		}
+	}
+
+	/* a byte key record takes at least the hash and the length */
+	if (f->size > records_size / (record ? record :
+				sizeof(uint64) + sizeof(struct bytes_key)) ||
+			(record && f->size != records_size / record)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/* checks that the whole record at r ends by end, its length may be corrupt */
+static int __fzset_record_fits(frozen_hash_set_t *f, const char *r,
+		const char *end)
+{
+	size_t left = end - r;
+	if (f->key_size) {
+		return __fzset_record_size(f->key_size, f->elem_size, NULL) <= left;
+	}
+
+	return left >= sizeof(uint64) + sizeof(struct bytes_key) &&
+		__fzset_record_size(0, 0, r + sizeof(uint64)) <= left;
+}
+
+/* bytes of a record, data is only read for variable length keys */
+static size_t __fzset_record_size(size_t key_size, size_t elem_size,
+		const void *data)
+{
+	size_t size = sizeof(uint64);
+	if (key_size) {
+		size += elem_size;
+	} else {
+		size += sizeof(struct bytes_key) +
+			((const struct bytes_key *)data)->length + 1;
+	}
+
+	return (size + sizeof(uint64) - 1) & ~(sizeof(uint64) - 1);
+}
+
+static void __fzset_iter_head(iterator_t *it, frozen_hash_set_t *f)
+{
+	assert(it && f);
+
+	memset(it, 0, sizeof(iterator_t));
+	if (!fzset_empty(f) && __fzset_record_fits(f, f->records,
+				f->records + f->offsets[f->bucket_size])) {
+		it->ptr = (void *)f->records;
+		it->data = (void *)(f->records + sizeof(uint64));
+		it->key = it->data;
+		it->bkt_index = 0;	/* byte offset of the record */
+		it->i = 0;
+		it->size = fzset_size(f);
+	} else {
+		it->ptr = NULL;
+	}
+}
+
+static void __fzset_iter_next(iterator_t *it, frozen_hash_set_t *f)
+{
+	assert(it && f && it->ptr);
+
+	const char *end = f->records + f->offsets[f->bucket_size];
+	if (++it->i < it->size) {
+		it->bkt_index += __fzset_record_size(f->key_size, f->elem_size,
+				it->data);
+		if (!__fzset_record_fits(f, f->records + it->bkt_index, end)) {
+			it->ptr = NULL;
+			return;
+		}
+		it->ptr = (void *)(f->records + it->bkt_index);
+		it->data = (void *)(f->records + it->bkt_index + sizeof(uint64));
+		it->key = it->data;
+	} else {
+		it->ptr = NULL;
+	}
+}
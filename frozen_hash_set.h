@@ -0,0 +1,56 @@
+#ifndef _FROZEN_HASH_SET_H_
+#define _FROZEN_HASH_SET_H_
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util_define.h"
+#include "iterator.h"
+#include "hash_set.h"
+
+typedef struct frozen_hash_set frozen_hash_set_t;
+
+/*
+ * read only hash set mapped from a file written by hset_freeze. the file
+ * holds a bucket offset array and the records of each bucket stored
+ * contiguously, a record being the 64 bit hash followed by the element.
+ * all references are offsets, so processes mapping the same file share
+ * its pages. the hash function must be the one the set was built with.
+ */
+struct frozen_hash_set {
+	char *base;			/* the whole mapping */
+	size_t length;
+	const uint64 *offsets;		/* bucket_size + 1 record offsets */
+	const char *records;
+	size_t bucket_size;		/* a power of two */
+	size_t size;
+	size_t elem_size;
+	size_t key_size;		/* 0 for variable length keys */
+	uint64 (*hash)(const void *key, size_t length);
+	void (*iter_head)(iterator_t *it, frozen_hash_set_t *f);
+	void (*iter_next)(iterator_t *it, frozen_hash_set_t *f);
+};
+
+/* function prototype */
+int hset_freeze(hash_set_t *h, const char *path);
+int fzset_map(frozen_hash_set_t *f, const char *path,
+		uint64 (*hash_func)(const void *, size_t));
+void fzset_unmap(frozen_hash_set_t *f);
+void fzset_find(frozen_hash_set_t *f, void *key, iterator_t *it);
+void fzset_find_bytes(frozen_hash_set_t *f, const void *bytes, size_t length,
+		iterator_t *it);
+
+/* checks whether the hash set is empty */
+static inline int fzset_empty(frozen_hash_set_t *f)
+{
+	assert(f);
+	return !f->size;
+}
+
+/* return the number of elements */
+static inline size_t fzset_size(frozen_hash_set_t *f)
+{
+	assert(f);
+	return f->size;
+}
+
+#endif
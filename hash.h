@@ -1,8 +1,18 @@
 #ifndef _HASH_H_
 #define _HASH_H_
+#include <stddef.h>
+#include <string.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define HASH_CRC32C_SSE42
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define HASH_CRC32C_ARM
+#endif
 
 typedef unsigned char uint8;
 typedef unsigned int uint32;
+typedef unsigned long long uint64;
 
 #define rot(x,k) (((x)<<(k)) | ((x)>>(32-(k))))
 #define mix(a,b,c) \
@@ -85,4 +95,200 @@ static inline uint32 hash(const void *key, size_t length)
 	return hashlittle32(key, length, 0);
 }
 
+/*
+ * 64-bit hash functions, all of the form uint64 f(const void *key,
+ * size_t length) so they can be plugged into the containers. none of
+ * them reads past the end of the key.
+ */
+
+/* 64x64 -> 128 multiply, returns low ^ high */
+static inline uint64 __hash_mix64(uint64 a, uint64 b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = (__uint128_t)a * b;
+	return (uint64)r ^ (uint64)(r >> 64);
+#else
+	uint64 ha = a >> 32, hb = b >> 32, la = (uint32)a, lb = (uint32)b;
+	uint64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64 t = rl + (rm0 << 32), c = t < rl;
+	uint64 lo = t + (rm1 << 32);
+	c += lo < t;
+	return lo ^ (rh + (rm0 >> 32) + (rm1 >> 32) + c);
+#endif
+}
+
+static inline uint64 __hash_read64(const uint8 *p)
+{
+	uint64 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64 __hash_read32(const uint8 *p)
+{
+	uint32 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+#define WYP0	0xa0761d6478bd642full
+#define WYP1	0xe7037ed1a0b428dbull
+#define WYP2	0x8ebc6af09c88c6e3ull
+#define WYP3	0x589965cc75374cc3ull
+
+/* wyhash style hash after Wang Yi's public domain wyhash, 48 bytes per round */
+static inline uint64 hashwy64(const void *key, size_t length, uint64 seed)
+{
+	const uint8 *p = (const uint8 *)key;
+	uint64 a, b;
+
+	seed ^= WYP0;
+	if (length <= 16) {
+		if (length >= 4) {
+			a = (__hash_read32(p) << 32) |
+				__hash_read32(p + ((length >> 3) << 2));
+			b = (__hash_read32(p + length - 4) << 32) |
+				__hash_read32(p + length - 4 - ((length >> 3) << 2));
+		} else if (length > 0) {
+			a = ((uint64)p[0] << 16) | ((uint64)p[length >> 1] << 8) |
+				p[length - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t i = length;
+		if (i > 48) {
+			uint64 see1 = seed, see2 = seed;
+			do {
+				seed = __hash_mix64(__hash_read64(p) ^ WYP1,
+						__hash_read64(p + 8) ^ seed);
+				see1 = __hash_mix64(__hash_read64(p + 16) ^ WYP2,
+						__hash_read64(p + 24) ^ see1);
+				see2 = __hash_mix64(__hash_read64(p + 32) ^ WYP3,
+						__hash_read64(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+
+		while (i > 16) {
+			seed = __hash_mix64(__hash_read64(p) ^ WYP1,
+					__hash_read64(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+
+		a = __hash_read64(p + i - 16);
+		b = __hash_read64(p + i - 8);
+	}
+
+	return __hash_mix64(WYP1 ^ length, __hash_mix64(a ^ WYP1, b ^ seed));
+}
+
+/* default 64-bit hash function */
+static inline uint64 hash64(const void *key, size_t length)
+{
+	return hashwy64(key, length, 0);
+}
+
+/* bitwise crc32c, used when the cpu has no crc instruction */
+static inline uint32 __crc32c_soft(uint32 crc, const uint8 *p, size_t length)
+{
+	while (length--) {
+		int k;
+		crc ^= *p++;
+		for (k = 0; k < 8; k++) {
+			crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+		}
+	}
+	return crc;
+}
+
+#ifdef HASH_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static inline uint32 __crc32c_hw(uint32 crc, const uint8 *p, size_t length)
+{
+	uint64 c = crc;
+	for (; length >= 8; length -= 8, p += 8) {
+		c = _mm_crc32_u64(c, __hash_read64(p));
+	}
+	crc = (uint32)c;
+	for (; length > 0; length--) {
+		crc = _mm_crc32_u8(crc, *p++);
+	}
+	return crc;
+}
+
+/* checks once whether the cpu has the sse4.2 crc32 instruction */
+static inline int __crc32c_hw_supported(void)
+{
+	static int supported = -1;
+	if (supported < 0) {
+		__builtin_cpu_init();
+		supported = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+	}
+	return supported;
+}
+#elif defined(HASH_CRC32C_ARM)
+static inline uint32 __crc32c_hw(uint32 crc, const uint8 *p, size_t length)
+{
+	for (; length >= 8; length -= 8, p += 8) {
+		crc = __crc32cd(crc, __hash_read64(p));
+	}
+	for (; length > 0; length--) {
+		crc = __crc32cb(crc, *p++);
+	}
+	return crc;
+}
+
+#define __crc32c_hw_supported()	1
+#else
+#define __crc32c_hw(crc, p, length)	__crc32c_soft(crc, p, length)
+#define __crc32c_hw_supported()	0
+#endif
+
+/* crc32c of the key spread to 64 bits, hardware crc when available */
+static inline uint64 hash_crc32c(const void *key, size_t length)
+{
+	const uint8 *p = (const uint8 *)key;
+	uint32 crc = __crc32c_hw_supported() ?
+		__crc32c_hw(0xffffffff, p, length) :
+		__crc32c_soft(0xffffffff, p, length);
+	uint64 h = (uint64)~crc * 0x9e3779b97f4a7c15ull;
+	return h ^ (h >> 32);
+}
+
+/* reads an integer key of 1, 2, 4 or 8 bytes */
+static inline uint64 __hash_read_int(const void *key, size_t length)
+{
+	switch (length) {
+	case 1: return *(const uint8 *)key;
+	case 2: { unsigned short v; memcpy(&v, key, 2); return v; }
+	case 4: return __hash_read32((const uint8 *)key);
+	default: return __hash_read64((const uint8 *)key);
+	}
+}
+
+/* the integer key itself, for keys that are already well distributed */
+static inline uint64 hash_identity64(const void *key, size_t length)
+{
+	if (length != 1 && length != 2 && length != 4 && length != 8) {
+		return hash64(key, length);
+	}
+	return __hash_read_int(key, length);
+}
+
+/* fibonacci hash of an integer key, high bits folded into the low ones */
+static inline uint64 hash_fib64(const void *key, size_t length)
+{
+	if (length != 1 && length != 2 && length != 4 && length != 8) {
+		return hash64(key, length);
+	}
+
+	uint64 h = __hash_read_int(key, length) * 0x9e3779b97f4a7c15ull;
+	return h ^ (h >> 32);
+}
+
 #endif
@@ -0,0 +1,86 @@
+/*
+ * microbenchmark of the hash functions in hash.h on short and long keys.
+ * hash_fib64 only mixes 1, 2, 4 and 8 byte integers and falls back to
+ * hash64 for other lengths, so its long key rows time hash64.
+ *
+ * gcc -O2 -DNDEBUG -std=gnu99 hash_bench.c -o hash_bench
+ * ./hash_bench [megabytes_per_run]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "hash.h"
+
+#define BENCH_KEYS	1024	/* distinct keys cycled through, a power of two */
+
+static uint64 __hash_little32(const void *key, size_t length)
+{
+	return hashlittle32(key, length, 0);
+}
+
+static const struct {
+	const char *name;
+	uint64 (*hash)(const void *key, size_t length);
+} hashes[] = {
+	{ "hash64", hash64 },
+	{ "hash_crc32c", hash_crc32c },
+	{ "hash_fib64", hash_fib64 },
+	{ "hashlittle32", __hash_little32 },
+};
+
+static double __bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t lengths[] = { 8, 16, 64, 1024 };
+	size_t megabytes = (argc > 1) ? strtoul(argv[1], NULL, 10) : 256;
+
+	unsigned char *keys = malloc(BENCH_KEYS * 1024);
+	if (keys == NULL) {
+		return 1;
+	}
+	size_t i;
+	for (i = 0; i < BENCH_KEYS * 1024; i++) {
+		keys[i] = rand();
+	}
+
+	printf("%-14s", "key bytes");
+	for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+		printf("%14zu", lengths[i]);
+	}
+	printf("\n%-14s%14s\n", "", "(ns per hash)");
+
+	size_t f;
+	for (f = 0; f < sizeof(hashes) / sizeof(hashes[0]); f++) {
+		printf("%-14s", hashes[f].name);
+		for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+			size_t length = lengths[i];
+			size_t n = megabytes * 1024 * 1024 / length;
+			volatile uint64 sink = 0;
+			uint64 acc = 0;
+			size_t j;
+
+			double start = __bench_now();
+			for (j = 0; j < n; j++) {
+				/* a dependency on acc keeps the calls serial */
+				size_t k = (j + (acc & 1)) & (BENCH_KEYS - 1);
+				acc += hashes[f].hash(keys + k * length, length);
+			}
+			double elapsed = __bench_now() - start;
+
+			sink = acc;
+			(void)sink;
+			printf("%14.2f", elapsed * 1e9 / n);
+		}
+		printf("\n");
+	}
+
+	free(keys);
+	return 0;
+}
@@ -0,0 +1,135 @@
+#ifndef _HASH_MAP_H_
+#define _HASH_MAP_H_
+#include "hash_set.h"
+
+#define HMAP_INIT(m, key_size, value_size)	\
+	hmap_init((m), (key_size), (value_size), NULL)
+
+typedef struct hash_map hash_map_t;
+
+/*
+ * key value map on top of hash_set_t, an entry is the key followed by the
+ * value, which is aligned for its size up to 8 bytes. iterators set key to
+ * the key and data to the value.
+ */
+struct hash_map {
+	hash_set_t h;
+	size_t key_size;
+	size_t value_size;
+	size_t value_offset;
+	void (*iter_head)(iterator_t *it, hash_map_t *m);
+	void (*iter_next)(iterator_t *it, hash_map_t *m);
+};
+
+static inline void __hmap_iter_set(iterator_t *it, hash_map_t *m)
+{
+	if (it->ptr != NULL) {
+		it->key = it->data;
+		it->data = (char *)it->key + m->value_offset;
+	}
+}
+
+static inline void __hmap_iter_head(iterator_t *it, hash_map_t *m)
+{
+	assert(it && m);
+	m->h.iter_head(it, &m->h);
+	__hmap_iter_set(it, m);
+}
+
+static inline void __hmap_iter_next(iterator_t *it, hash_map_t *m)
+{
+	assert(it && m);
+	m->h.iter_next(it, &m->h);
+	__hmap_iter_set(it, m);
+}
+
+/* initialize the hash map, keys are compared by cmp_func or memcmp */
+static inline void hmap_init(hash_map_t *m, size_t key_size,
+		size_t value_size, int (*cmp_func)(void *, void *))
+{
+	assert(m && key_size > 0 && value_size > 0);
+
+	size_t align = 8;
+	while (value_size % align) {
+		align /= 2;
+	}
+
+	m->key_size = key_size;
+	m->value_size = value_size;
+	m->value_offset = (key_size + align - 1) & ~(align - 1);
+	hset_init(&m->h, m->value_offset + value_size, NULL, NULL, cmp_func);
+	__set_key_size(&m->h, key_size);
+	m->iter_head = __hmap_iter_head;
+	m->iter_next = __hmap_iter_next;
+}
+
+/* destroy the hash map */
+static inline void hmap_destroy(hash_map_t *m)
+{
+	assert(m);
+	hset_destroy(&m->h);
+}
+
+/* remove all entries */
+static inline void hmap_clear(hash_map_t *m)
+{
+	assert(m);
+	hset_clear(&m->h);
+}
+
+/* checks whether the hash map is empty */
+static inline int hmap_empty(hash_map_t *m)
+{
+	assert(m);
+	return hset_empty(&m->h);
+}
+
+/* return the number of entries */
+static inline size_t hmap_size(hash_map_t *m)
+{
+	assert(m);
+	return hset_size(&m->h);
+}
+
+/* returns the value of key, or NULL */
+static inline void* hmap_get(hash_map_t *m, void *key)
+{
+	assert(m && key);
+
+	iterator_t it;
+	hset_find(&m->h, key, &it);
+	return (it.ptr != NULL) ? (char *)it.data + m->value_offset : NULL;
+}
+
+/*
+ * returns the value of key for in place update, a missing key is inserted
+ * with a zeroed value. the key is hashed once.
+ */
+static inline void* hmap_get_or_insert(hash_map_t *m, void *key)
+{
+	assert(m && key);
+	return (char *)hset_find_or_insert(&m->h, key, NULL) + m->value_offset;
+}
+
+/* sets the value of key, inserting it if missing */
+static inline void hmap_put(hash_map_t *m, void *key, void *value)
+{
+	assert(m && key && value);
+	memcpy(hmap_get_or_insert(m, key), value, m->value_size);
+}
+
+/* erases the entry of key */
+static inline void hmap_erase(hash_map_t *m, void *key)
+{
+	assert(m && key);
+	hset_erase(&m->h, key);
+}
+
+/* presizes the map for n entries */
+static inline void hmap_reserve(hash_map_t *m, size_t n)
+{
+	assert(m);
+	hset_reserve(&m->h, n);
+}
+
+#endif
@@ -1,12 +1,65 @@
+#include <pthread.h>
 #include "hash_set.h"
 
+/* nodes of src kept by a set operation, from one range of its buckets */
+struct hset_select_task {
+	hash_set_t *src;
+	hash_set_t *other;	/* probed for each node */
+	int keep_found;		/* keep nodes found in other, else the missing */
+	size_t first;		/* iteration bucket range */
+	size_t last;
+	struct chain_node **nodes;
+	size_t size;
+	size_t capacity;
+};
+
 /* function prototypes */
-static int __hset_insert_node(hash_set_t *h, struct chain_node *n);
-static void __hset_expand(hash_set_t *h);
+static void __hset_init_like(hash_set_t *dest, hash_set_t *h, size_t n);
+static void __hset_select(hash_set_t *dest, hash_set_t *src,
+		hash_set_t *other, int keep_found, size_t threads);
+static void* __hset_select_range(void *arg);
+static void __hset_copy_all(hash_set_t *dest, hash_set_t *src);
+static void __hset_copy_node(hash_set_t *h, struct chain_node *n);
+static void __hset_prefetch(hash_set_t *h, uint64 *hashvals, size_t n);
+static void __hset_link_node(hash_set_t *h, struct chain_node *n);
+static struct chain_node* __hset_alloc_node(hash_set_t *h);
+static struct chain_node* __hset_alloc_bytes_node(hash_set_t *h,
+		size_t size);
+static void* __hset_slab_alloc(hash_set_t *h, size_t size);
+static void __hset_erase_node(hash_set_t *h, struct bucket *b,
+		struct chain_node **link);
+static void __hset_free_slabs(hash_set_t *h);
+static struct chain_node** __hset_lookup(hash_set_t *h, const void *key,
+		size_t length, uint64 hashval, struct bucket **bucket);
+static void __hset_resize(hash_set_t *h, size_t bucket_size);
+static size_t __hset_bucket_count(hash_set_t *h, size_t n);
+static void __hset_set_limits(hash_set_t *h);
 static void __free_bucket(hash_set_t *h, struct bucket *b);
+static struct chain_node** __find_link(hash_set_t *h, struct bucket *b,
+		const void *key, size_t length, uint64 hashval);
+static void __migrate_bucket(hash_set_t *h, struct bucket *b);
+static void __hset_end_migration(hash_set_t *h);
+static struct bucket* __iter_bucket(hash_set_t *h, size_t index);
+static struct bucket* __hset_alloc_buckets(size_t bucket_size);
+static void __hset_mark(hash_set_t *h, struct bucket *b);
+static size_t __hset_next_bucket(hash_set_t *h, size_t index);
+static size_t __bitmap_next(uint64 *bitmap, size_t index, size_t n);
 static void __hset_iter_head(iterator_t *it, hash_set_t *h);
 static void __hset_iter_next(iterator_t *it, hash_set_t *h);
 
+/* size of a node holding a byte key of length bytes, a multiple of 8 */
+static inline size_t __bytes_node_size(size_t length)
+{
+	return (sizeof(struct chain_node) + sizeof(struct bytes_key) + length +
+			sizeof(uint64)) & ~(sizeof(uint64) - 1);
+}
+
+/* occupancy bitmap stored after the buckets, bit i is set if bucket i has nodes */
+static inline uint64* __bucket_bitmap(struct bucket *buckets, size_t bucket_size)
+{
+	return (uint64 *)(buckets + bucket_size);
+}
+
 /* initialize the hash set */
 void hset_init(hash_set_t *h, size_t elem_size,
 		void (*copy_func)(void *, void *),
@@ -15,196 +68,639 @@ void hset_init(hash_set_t *h, size_t elem_size,
 {
 	assert(h && elem_size > 0);
 
+	/* bucket_size stays a power of two, buckets are selected by mask */
 	memset(h, 0, sizeof(hash_set_t));
 	h->bucket_size = DEFAULT_CONTAINER_CAPACITY;
-	h->buckets = malloc(sizeof(struct bucket) * h->bucket_size);
-	assert(h->buckets);
-	memset(h->buckets, 0, sizeof(struct bucket) * h->bucket_size);
+	h->buckets = __hset_alloc_buckets(h->bucket_size);
 
 	h->elem_size = elem_size;
 	h->key_size = elem_size;
-	h->max_bucket_capacity = MAX_BUCKET_CAPACITY;
+	h->node_size = (sizeof(struct chain_node) + elem_size +
+			sizeof(uint64) - 1) & ~(sizeof(uint64) - 1);
+	h->slab_nodes = DEFAULT_CONTAINER_CAPACITY;
+	h->max_load_factor = HSET_MAX_LOAD_FACTOR;
+	__hset_set_limits(h);
 	h->copy = copy_func;
 	h->free = free_func;
 	h->compare = cmp_func;
+	h->hash = hash64;
 	h->iter_head = __hset_iter_head;
 	h->iter_next = __hset_iter_next;
 }
 
+/*
+ * initialize a hash set of variable length keys, which are copied into the
+ * chain nodes as a struct bytes_key. use the _bytes functions with it.
+ */
+void hset_init_bytes(hash_set_t *h)
+{
+	assert(h);
+
+	hset_init(h, sizeof(struct bytes_key), NULL, NULL, NULL);
+	h->key_size = 0;
+	h->node_size = 64;	/* only sizes the slabs */
+	h->free_bytes = calloc(HSET_BYTES_CLASSES, sizeof(struct chain_node *));
+	assert(h->free_bytes);
+}
+
 /* remove all elements */
 void hset_clear(hash_set_t *h)
 {
 	assert(h);
 
+	/* only occupied buckets are visited */
 	size_t i;
-	for (i = 0; i < h->bucket_size; i++) {
-		__free_bucket(h, &h->buckets[i]);
+	size_t end = h->old_bucket_size + h->bucket_size;
+	for (i = __hset_next_bucket(h, 0); i < end;
+			i = __hset_next_bucket(h, i + 1)) {
+		__free_bucket(h, __iter_bucket(h, i));
 	}
+
+	if (h->old_buckets != NULL) {
+		__hset_end_migration(h);
+	}
+	bloom_clear(&h->filter);
+
+	__hset_free_slabs(h);
 	h->size = 0;
 }
 
 /* inserts elements */
 void hset_insert(hash_set_t *h, void *key)
 {
-	assert(h && key && h->buckets);
+	assert(h && key);
+	hset_insert_hashed(h, key, h->hash(key, h->key_size));
+}
+
+/* inserts elements whose hash was computed by hset_hash */
+void hset_insert_hashed(hash_set_t *h, void *key, uint64 hashval)
+{
+	assert(h && key && h->buckets && h->key_size);
+
+	if (h->old_buckets != NULL) {
+		hset_rehash_step(h, HSET_REHASH_BUCKETS);
+	}
 
-	struct chain_node *tmp = malloc(sizeof(struct chain_node) + h->elem_size);
-	assert(tmp);
-	tmp->next = NULL;
-	CONTAINER_COPY(tmp->data, key, h);
-	int ret = __hset_insert_node(h, tmp);
-	if (ret < 0) {
-		__free_chain_node(h, tmp);
+	/* duplicates are rejected before a node is taken */
+	struct bucket *b;
+	if (__hset_lookup(h, key, h->key_size, hashval, &b) != NULL) {
+		return;
 	}
+
+	struct chain_node *n = __hset_alloc_node(h);
+	n->hash = hashval;
+	CONTAINER_COPY(n->data, key, h);
+	__hset_link_node(h, n);
 }
 
 /* erases elements */
 void hset_erase(hash_set_t *h, void *key)
 {
-	assert(h && key && h->buckets);
+	assert(h && key && h->buckets && h->key_size);
 
-	size_t bkt_index = hash(key, h->key_size) % h->bucket_size;
-	struct bucket *b = &h->buckets[bkt_index];
-	struct chain_node *next = b->first;
-	if (!next) {
+	if (h->old_buckets != NULL) {
+		hset_rehash_step(h, HSET_REHASH_BUCKETS);
+	}
+
+	struct bucket *b;
+	struct chain_node **link = __hset_lookup(h, key, h->key_size,
+			h->hash(key, h->key_size), &b);
+	if (link != NULL) {
+		__hset_erase_node(h, b, link);
+	}
+}
+
+/* finds element with sepcific key */
+void hset_find(hash_set_t *h, void *key, iterator_t *it)
+{
+	assert(h && key && it);
+	hset_find_hashed(h, key, h->hash(key, h->key_size), it);
+}
+
+/* finds element with specific key whose hash was computed by hset_hash */
+void hset_find_hashed(hash_set_t *h, void *key, uint64 hashval,
+		iterator_t *it)
+{
+	assert(h && key && it && h->key_size);
+
+	if (h->buckets == NULL) {
+		it->ptr = NULL;
 		return;
 	}
 
-	struct chain_node *prev = NULL;
-	int find = 0;
-	if (EQUALS(key, next->data, h)) {
-		find = 1;
-	} else {
-		prev = next;
-		next = next->next;
-		while (next) {
-			if (EQUALS(key, next->data, h)) {
-				find = 1;
-				break;
-			}
+	struct bucket *b;
+	struct chain_node **link = __hset_lookup(h, key, h->key_size,
+			hashval, &b);
+	if (link != NULL) {
+		it->ptr = *link;
+		it->data = (*link)->data;
+		it->key = it->data;
+		return;
+	}
+
+	it->ptr = NULL;
+}
+
+/*
+ * returns the element with specific key, hashing it once. a missing key
+ * is inserted as an element whose first key_size bytes are copied from
+ * key and whose remaining bytes are zero, the copy function is not used.
+ * *inserted, if not NULL, tells which case happened.
+ */
+void* hset_find_or_insert(hash_set_t *h, void *key, int *inserted)
+{
+	assert(h && key && h->buckets && h->key_size);
+
+	if (h->old_buckets != NULL) {
+		hset_rehash_step(h, HSET_REHASH_BUCKETS);
+	}
+
+	uint64 hashval = h->hash(key, h->key_size);
+	struct bucket *b;
+	struct chain_node **link = __hset_lookup(h, key, h->key_size,
+			hashval, &b);
+	if (inserted != NULL) {
+		*inserted = (link == NULL);
+	}
+	if (link != NULL) {
+		return (*link)->data;
+	}
+
+	struct chain_node *n = __hset_alloc_node(h);
+	n->hash = hashval;
+	memcpy(n->data, key, h->key_size);
+	memset(n->data + h->key_size, 0, h->elem_size - h->key_size);
+	__hset_link_node(h, n);
+	return n->data;
+}
+
+/*
+ * inserts n elements stored contiguously in elements, all hashes are
+ * computed and the buckets prefetched before the first insertion
+ */
+void hset_insert_batch(hash_set_t *h, void *elements, size_t n)
+{
+	assert(h && (elements || !n) && h->buckets && h->key_size);
+
+	uint64 hashvals[HSET_BATCH_SIZE];
+	char *e = elements;
+	while (n > 0) {
+		size_t count = (n < HSET_BATCH_SIZE) ? n : HSET_BATCH_SIZE;
+		size_t i;
+		for (i = 0; i < count; i++) {
+			hashvals[i] = h->hash(e + i * h->elem_size, h->key_size);
+		}
 
-			prev = next;
-			next = next->next;
+		__hset_prefetch(h, hashvals, count);
+		for (i = 0; i < count; i++) {
+			hset_insert_hashed(h, e + i * h->elem_size, hashvals[i]);
 		}
+
+		e += count * h->elem_size;
+		n -= count;
 	}
+}
 
-	if (find) {
-		if (prev) {
-			prev->next = next->next;
+/*
+ * finds n keys stored contiguously in keys, results[i] is set to the
+ * element matching key i or NULL. the lookups of a batch overlap their
+ * cache misses instead of waiting for each chain in turn.
+ */
+void hset_find_batch(hash_set_t *h, void *keys, size_t n, void **results)
+{
+	assert(h && (keys || !n) && results && h->key_size);
+
+	uint64 hashvals[HSET_BATCH_SIZE];
+	char *k = keys;
+	while (n > 0) {
+		size_t count = (n < HSET_BATCH_SIZE) ? n : HSET_BATCH_SIZE;
+		size_t i;
+		if (h->buckets == NULL) {
+			memset(results, 0, sizeof(void *) * count);
 		} else {
-			b->first = next->next;
+			for (i = 0; i < count; i++) {
+				hashvals[i] = h->hash(k + i * h->key_size,
+						h->key_size);
+			}
+
+			__hset_prefetch(h, hashvals, count);
+			for (i = 0; i < count; i++) {
+				struct bucket *b;
+				struct chain_node **link = __hset_lookup(h,
+						k + i * h->key_size, h->key_size,
+						hashvals[i], &b);
+				results[i] = (link != NULL) ? (*link)->data : NULL;
+			}
 		}
 
-		__free_chain_node(h, next);
-		b->size--;
-		h->size--;
+		k += count * h->key_size;
+		results += count;
+		n -= count;
 	}
 }
 
-/* finds element with sepcific key */
-void hset_find(hash_set_t *h, void *key, iterator_t *it)
+/* inserts a copy of length bytes at bytes as a key */
+void hset_insert_bytes(hash_set_t *h, const void *bytes, size_t length)
 {
-	assert(h && key && it);
+	assert(h && (bytes || !length) && h->buckets && !h->key_size);
+	assert(length < (uint32)-1);
 
-	if (h->buckets == NULL) {
-		it->ptr = NULL;
+	if (h->old_buckets != NULL) {
+		hset_rehash_step(h, HSET_REHASH_BUCKETS);
+	}
+
+	uint64 hashval = h->hash(bytes, length);
+	struct bucket *b;
+	if (__hset_lookup(h, bytes, length, hashval, &b) != NULL) {
 		return;
 	}
 
-	size_t bkt_index = hash(key, h->key_size) % h->bucket_size;
-	struct bucket *b = &h->buckets[bkt_index];
-	struct chain_node *next = b->first;
-	while (next != NULL) {
-		if (EQUALS(key, next->data, h)) {
-			it->ptr = next;
-			it->data = next->data;
-			it->key = it->data;
-			return;
-		}
+	struct chain_node *n = __hset_alloc_bytes_node(h,
+			__bytes_node_size(length));
+	struct bytes_key *k = (struct bytes_key *)n->data;
+	n->hash = hashval;
+	k->length = length;
+	memcpy(k->bytes, bytes, length);
+	k->bytes[length] = '\0';
+	__hset_link_node(h, n);
+}
 
-		next = next->next;
+/* erases the key of length bytes at bytes */
+void hset_erase_bytes(hash_set_t *h, const void *bytes, size_t length)
+{
+	assert(h && (bytes || !length) && h->buckets && !h->key_size);
+
+	if (h->old_buckets != NULL) {
+		hset_rehash_step(h, HSET_REHASH_BUCKETS);
+	}
+
+	struct bucket *b;
+	struct chain_node **link = __hset_lookup(h, bytes, length,
+			h->hash(bytes, length), &b);
+	if (link != NULL) {
+		__hset_erase_node(h, b, link);
 	}
+}
+
+/* finds the key of length bytes at bytes, it->data is its struct bytes_key */
+void hset_find_bytes(hash_set_t *h, const void *bytes, size_t length,
+		iterator_t *it)
+{
+	assert(h && (bytes || !length) && it && !h->key_size);
 
 	it->ptr = NULL;
+	if (h->buckets == NULL) {
+		return;
+	}
+
+	struct bucket *b;
+	struct chain_node **link = __hset_lookup(h, bytes, length,
+			h->hash(bytes, length), &b);
+	if (link != NULL) {
+		it->ptr = *link;
+		it->data = (*link)->data;
+		it->key = it->data;
+	}
 }
 
-/* inserts node */
-static int __hset_insert_node(hash_set_t *h, struct chain_node *n)
+/* migrates at most budget buckets of the old table, returns 1 if some are left */
+int hset_rehash_step(hash_set_t *h, size_t budget)
 {
-	assert(h && n && h->buckets && n->data);
+	assert(h);
 
-	void *key = n->data;
-	size_t bkt_index = hash(key, h->key_size) % h->bucket_size;
-	struct bucket *b = &h->buckets[bkt_index];
+	if (h->old_buckets == NULL) {
+		return 0;
+	}
 
-	/* find duplicate */
-	struct chain_node *next = b->first;
-	while (next != NULL) {
-		if (EQUALS(next->data, n->data, h)) {
-			return -1;
-		}
+	while (budget-- > 0 && h->rehash_index < h->old_bucket_size) {
+		__migrate_bucket(h, &h->old_buckets[h->rehash_index++]);
+	}
+
+	if (h->rehash_index < h->old_bucket_size) {
+		return 1;
+	}
 
-		next = next->next;
+	__hset_end_migration(h);
+	return 0;
+}
+
+/* sizes the bucket array for n elements, never shrinks */
+void hset_reserve(hash_set_t *h, size_t n)
+{
+	assert(h && h->buckets);
+
+	size_t bucket_size = __hset_bucket_count(h, n);
+	if (bucket_size > h->bucket_size) {
+		__hset_resize(h, bucket_size);
+	}
+}
+
+/* sizes the bucket array for the current number of elements */
+void hset_shrink_to_fit(hash_set_t *h)
+{
+	assert(h && h->buckets);
+
+	size_t bucket_size = __hset_bucket_count(h, h->size);
+	if (bucket_size != h->bucket_size) {
+		__hset_resize(h, bucket_size);
+	}
+}
+
+/*
+ * puts a blocked bloom filter of bits_per_key bits per element in front
+ * of the lookups, so most misses touch one cache line and no chain. the
+ * filter is rebuilt on resize, erased keys stay in it until then. 0
+ * removes the filter.
+ */
+void hset_set_filter(hash_set_t *h, size_t bits_per_key)
+{
+	assert(h && h->buckets);
+
+	hset_rehash_step(h, (size_t)-1);
+	bloom_destroy(&h->filter);
+	if (bits_per_key == 0) {
+		return;
 	}
 
-	/* find which bucket to insert */
-	int i = 0;
-	while (1) {
-		if (i > 0) {
-			bkt_index = hash(key, h->key_size) % h->bucket_size;
-			b = &h->buckets[bkt_index];
+	bloom_init(&h->filter, h->grow_size, bits_per_key);
+	size_t i;
+	for (i = __hset_next_bucket(h, 0); i < h->bucket_size;
+			i = __hset_next_bucket(h, i + 1)) {
+		struct chain_node *next;
+		for (next = h->buckets[i].first; next != NULL; next = next->next) {
+			bloom_add_hashed(&h->filter, next->hash);
 		}
+	}
+}
 
-		i++;
-		if (b->size < h->max_bucket_capacity) {
-			break;
-		} else {
-			if (h->has_long_chain && h->long_chain_index != bkt_index) {
-				/* expand */
-				__hset_expand(h);
-			} else {
-				h->has_long_chain = 1;
-				h->long_chain_index = bkt_index;
-				break;
-			}
+/*
+ * initializes dest as the union of h1 and h2, which must be configured
+ * alike. the larger set is copied, the nodes of the smaller one are
+ * probed against it using their cached hashes. with threads > 1 the
+ * buckets of the probed input are split among that many threads, the
+ * output is linked by the calling thread.
+ */
+void hset_union(hash_set_t *dest, hash_set_t *h1, hash_set_t *h2,
+		size_t threads)
+{
+	assert(dest && h1 && h2 && h1->hash == h2->hash);
+
+	hash_set_t *small = (h1->size < h2->size) ? h1 : h2;
+	hash_set_t *large = (small == h1) ? h2 : h1;
+	__hset_init_like(dest, h1, h1->size + h2->size);
+	__hset_copy_all(dest, large);
+	__hset_select(dest, small, large, 0, threads);
+}
+
+/* initializes dest as the elements of h1 also in h2, see hset_union */
+void hset_intersect(hash_set_t *dest, hash_set_t *h1, hash_set_t *h2,
+		size_t threads)
+{
+	assert(dest && h1 && h2 && h1->hash == h2->hash);
+
+	hash_set_t *small = (h1->size < h2->size) ? h1 : h2;
+	hash_set_t *large = (small == h1) ? h2 : h1;
+	__hset_init_like(dest, h1, small->size);
+	__hset_select(dest, small, large, 1, threads);
+}
+
+/* initializes dest as the elements of h1 not in h2, see hset_union */
+void hset_difference(hash_set_t *dest, hash_set_t *h1, hash_set_t *h2,
+		size_t threads)
+{
+	assert(dest && h1 && h2 && h1->hash == h2->hash);
+
+	__hset_init_like(dest, h1, h1->size);
+	__hset_select(dest, h1, h2, 0, threads);
+}
+
+/* sets the average number of elements per bucket before the table grows */
+void hset_set_max_load_factor(hash_set_t *h, float max_load_factor)
+{
+	assert(h && max_load_factor > 0);
+
+	h->max_load_factor = max_load_factor;
+	__hset_set_limits(h);
+	if (h->size > h->grow_size) {
+		hset_reserve(h, h->size);
+	}
+}
+
+/* prefetches the buckets of n hashes, then the first node of each chain */
+static void __hset_prefetch(hash_set_t *h, uint64 *hashvals, size_t n)
+{
+	size_t mask = h->bucket_size - 1;
+	size_t i;
+	for (i = 0; i < n; i++) {
+		__builtin_prefetch(&h->buckets[hashvals[i] & mask]);
+	}
+
+	for (i = 0; i < n; i++) {
+		struct chain_node *first = h->buckets[hashvals[i] & mask].first;
+		if (first != NULL) {
+			__builtin_prefetch(first);
 		}
 	}
+}
 
+/* links a node whose key is not in the set yet, n->hash must be set */
+static void __hset_link_node(hash_set_t *h, struct chain_node *n)
+{
+	assert(h && n && h->buckets);
+
+	struct bucket *b = &h->buckets[n->hash & (h->bucket_size - 1)];
 	n->next = b->first;
 	b->first = n;
-	b->size++;
+	if (b->size++ == 0) {
+		__hset_mark(h, b);
+	}
+	if (h->filter.blocks != NULL) {
+		bloom_add_hashed(&h->filter, n->hash);
+	}
 	h->size++;
 
-	return 0;
+	if (h->size > h->grow_size) {
+		__hset_resize(h, h->bucket_size * 2);
+	}
 }
 
-static void __hset_expand(hash_set_t *h)
+/* takes a node from the free list or the newest slab */
+static struct chain_node* __hset_alloc_node(hash_set_t *h)
 {
-	assert(h && h->buckets);
+	struct chain_node *n = h->free_nodes;
+	if (n != NULL) {
+		h->free_nodes = n->next;
+		return n;
+	}
 
-	size_t old_bkt_size = h->bucket_size;
-	h->bucket_size *= 2;
-	struct bucket *old_buckets = h->buckets;
-	struct bucket *new_buckets = malloc(sizeof(struct bucket) * h->bucket_size);
-	assert(new_buckets);
-	memset(new_buckets, 0, sizeof(struct bucket) * h->bucket_size);
+	return __hset_slab_alloc(h, h->node_size);
+}
 
-	h->buckets = new_buckets;
-	h->size = 0;
-	h->has_long_chain = 0;
+/*
+ * takes a byte key node of size bytes from its size class or a slab.
+ * nodes larger than the largest class are malloc'd and freed on erase.
+ */
+static struct chain_node* __hset_alloc_bytes_node(hash_set_t *h, size_t size)
+{
+	size_t c = size / sizeof(uint64);
+	if (c >= HSET_BYTES_CLASSES) {
+		struct chain_node *n = malloc(size);
+		assert(n);
+		return n;
+	}
 
-	size_t i;
-	for (i = 0; i < old_bkt_size; i++) {
-		struct bucket *b = &old_buckets[i];
-		struct chain_node *next = b->first;
-		while (next != NULL) {
-			struct chain_node *tmp = next->next;
-			__hset_insert_node(h, next);
-			next = tmp;
+	if (h->free_bytes[c] != NULL) {
+		struct chain_node *n = h->free_bytes[c];
+		h->free_bytes[c] = n->next;
+		return n;
+	}
+
+	return __hset_slab_alloc(h, size);
+}
+
+/* carves size bytes from the newest slab, the rest of a full slab is unused */
+static void* __hset_slab_alloc(hash_set_t *h, size_t size)
+{
+	if ((size_t)(h->slab_end - h->slab_next) < size) {
+		/* slabs double in size up to HSET_SLAB_MAX_NODES nodes */
+		size_t bytes = h->node_size * h->slab_nodes;
+		if (bytes < size) {
+			bytes = size;
+		}
+
+		struct node_slab *slab = malloc(sizeof(struct node_slab) + bytes);
+		assert(slab);
+		slab->next = h->slabs;
+		h->slabs = slab;
+		h->slab_next = slab->nodes;
+		h->slab_end = slab->nodes + bytes;
+		if (h->slab_nodes < HSET_SLAB_MAX_NODES) {
+			h->slab_nodes *= 2;
+		}
+	}
+
+	void *p = h->slab_next;
+	h->slab_next += size;
+	return p;
+}
+
+/* unlinks and frees the node at link of bucket b */
+static void __hset_erase_node(hash_set_t *h, struct bucket *b,
+		struct chain_node **link)
+{
+	struct chain_node *n = *link;
+	*link = n->next;
+	if (h->key_size) {
+		__free_chain_node(h, n);
+	} else {
+		struct bytes_key *k = (struct bytes_key *)n->data;
+		size_t c = __bytes_node_size(k->length) / sizeof(uint64);
+		if (c < HSET_BYTES_CLASSES) {
+			n->next = h->free_bytes[c];
+			h->free_bytes[c] = n;
+		} else {
+			free(n);
 		}
 	}
 
-	free(old_buckets);
+	if (--b->size == 0) {
+		__hset_mark(h, b);
+	}
+	h->size--;
+
+	if ((h->flags & HSET_AUTO_SHRINK) && h->size < h->shrink_size &&
+			h->old_buckets == NULL) {
+		__hset_resize(h, h->bucket_size / 2);
+	}
+}
+
+/* releases all slabs at once, every node must be unlinked */
+static void __hset_free_slabs(hash_set_t *h)
+{
+	struct node_slab *slab = h->slabs;
+	while (slab != NULL) {
+		struct node_slab *tmp = slab->next;
+		free(slab);
+		slab = tmp;
+	}
+
+	h->slabs = NULL;
+	h->slab_next = NULL;
+	h->slab_end = NULL;
+	h->slab_nodes = DEFAULT_CONTAINER_CAPACITY;
+	h->free_nodes = NULL;
+	if (h->free_bytes != NULL) {
+		memset(h->free_bytes, 0,
+				sizeof(struct chain_node *) * HSET_BYTES_CLASSES);
+	}
+}
+
+/* finds the link to the node holding key in both tables during a migration */
+static struct chain_node** __hset_lookup(hash_set_t *h, const void *key,
+		size_t length, uint64 hashval, struct bucket **bucket)
+{
+	struct bucket *b = &h->buckets[hashval & (h->bucket_size - 1)];
+	if (h->filter.blocks != NULL &&
+			!bloom_contains_hashed(&h->filter, hashval) &&
+			(h->old_filter.blocks == NULL ||
+			 !bloom_contains_hashed(&h->old_filter, hashval))) {
+		*bucket = b;
+		return NULL;
+	}
+
+	struct chain_node **link = __find_link(h, b, key, length, hashval);
+	if (link == NULL && h->old_buckets != NULL) {
+		b = &h->old_buckets[hashval & (h->old_bucket_size - 1)];
+		link = __find_link(h, b, key, length, hashval);
+	}
+
+	*bucket = b;
+	return link;
+}
+
+/* moves the nodes to a new bucket array, relinked by their cached hash */
+static void __hset_resize(hash_set_t *h, size_t bucket_size)
+{
+	assert(h && h->buckets && !(bucket_size & (bucket_size - 1)));
+
+	/* a previous migration must finish before the table is resized again */
+	hset_rehash_step(h, (size_t)-1);
+
+	h->old_buckets = h->buckets;
+	h->old_bucket_size = h->bucket_size;
+	h->rehash_index = 0;
+	h->bucket_size = bucket_size;
+	h->buckets = __hset_alloc_buckets(h->bucket_size);
+	__hset_set_limits(h);
+
+	/* the new table gets its own filter, filled as buckets migrate */
+	if (h->filter.blocks != NULL) {
+		h->old_filter = h->filter;
+		bloom_init(&h->filter, h->grow_size, h->old_filter.bits_per_key);
+	}
+
+	if (!(h->flags & HSET_INCREMENTAL)) {
+		hset_rehash_step(h, (size_t)-1);
+	}
+}
+
+/* smallest power of two bucket count holding n elements */
+static size_t __hset_bucket_count(hash_set_t *h, size_t n)
+{
+	size_t bucket_size = DEFAULT_CONTAINER_CAPACITY;
+	while ((float)bucket_size * h->max_load_factor < (float)n) {
+		bucket_size *= 2;
+	}
+
+	return bucket_size;
+}
+
+/* grow and shrink limits for the current bucket count */
+static void __hset_set_limits(hash_set_t *h)
+{
+	h->grow_size = (size_t)((float)h->bucket_size * h->max_load_factor);
+	h->shrink_size = (h->bucket_size > DEFAULT_CONTAINER_CAPACITY) ?
+		h->grow_size / 4 : 0;
 }
 
 static void __hset_iter_head(iterator_t *it, hash_set_t *h)
@@ -213,17 +709,11 @@ static void __hset_iter_head(iterator_t *it, hash_set_t *h)
 
 	memset(it, 0, sizeof(iterator_t));
 	if (!hset_empty(h)) {
-		struct bucket *b = NULL;
-		size_t i;
-		for (i = 0; i < h->bucket_size; i++) {
-			struct bucket *tmp = &h->buckets[i];
-			if (tmp->size > 0) {
-				b = tmp;
-				break;
-			}
-		}
+		/* old buckets under migration come first, then the new table */
+		size_t i = __hset_next_bucket(h, 0);
+		struct bucket *b = __iter_bucket(h, i);
 
-		assert(b && b->first);
+		assert(b->first);
 		it->ptr = b->first;
 		it->data = b->first->data;
 		it->key = it->data;
@@ -242,14 +732,9 @@ static void __hset_iter_next(iterator_t *it, hash_set_t *h)
 	struct chain_node *next = ((struct chain_node *)it->ptr)->next;
 	size_t bkt_index = it->bkt_index;
 	if (next == NULL) {
-		size_t i;
-		for (i = bkt_index + 1; i < h->bucket_size; i++) {
-			struct bucket *b = &h->buckets[i];
-			if (b->size > 0) {
-				next = b->first;
-				bkt_index = i;
-				break;
-			}
+		bkt_index = __hset_next_bucket(h, bkt_index + 1);
+		if (bkt_index < h->old_bucket_size + h->bucket_size) {
+			next = __iter_bucket(h, bkt_index)->first;
 		}
 	}
 
@@ -264,16 +749,318 @@ static void __hset_iter_next(iterator_t *it, hash_set_t *h)
 	}
 }
 
+/* empties the bucket, chains are only walked for the free callback */
 static void __free_bucket(hash_set_t *h, struct bucket *b)
 {
 	assert(b);
 
+	if (h->free != NULL) {
+		struct chain_node *next;
+		for (next = b->first; next != NULL; next = next->next) {
+			h->free(next->data);
+		}
+	}
+
+	if (h->key_size == 0) {
+		/* slab nodes go with the slabs, oversized byte key nodes are freed */
+		struct chain_node *n = b->first;
+		while (n != NULL) {
+			struct chain_node *next = n->next;
+			struct bytes_key *k = (struct bytes_key *)n->data;
+			if (__bytes_node_size(k->length) / sizeof(uint64) >=
+					HSET_BYTES_CLASSES) {
+				free(n);
+			}
+			n = next;
+		}
+	}
+
+	b->first = NULL;
+	b->size = 0;
+	__hset_mark(h, b);
+}
+
+/*
+ * returns the link pointing to the node holding key, or NULL. length is
+ * only used for variable length keys, which are rejected by hash and
+ * length before their bytes are compared.
+ */
+static struct chain_node** __find_link(hash_set_t *h, struct bucket *b,
+		const void *key, size_t length, uint64 hashval)
+{
+	struct chain_node **link = &b->first;
+	if (h->key_size == 0) {
+		while (*link != NULL) {
+			struct bytes_key *k = (struct bytes_key *)(*link)->data;
+			if ((*link)->hash == hashval && k->length == length &&
+					!memcmp(k->bytes, key, length)) {
+				return link;
+			}
+
+			link = &(*link)->next;
+		}
+
+		return NULL;
+	}
+
+	while (*link != NULL) {
+		if ((*link)->hash == hashval &&
+				EQUALS((void *)key, (*link)->data, h)) {
+			return link;
+		}
+
+		link = &(*link)->next;
+	}
+
+	return NULL;
+}
+
+/* moves the nodes of an old bucket to the new table */
+static void __migrate_bucket(hash_set_t *h, struct bucket *b)
+{
 	struct chain_node *next = b->first;
 	while (next != NULL) {
 		struct chain_node *tmp = next->next;
-		__free_chain_node(h, next);
+		struct bucket *dest =
+			&h->buckets[next->hash & (h->bucket_size - 1)];
+		next->next = dest->first;
+		dest->first = next;
+		if (dest->size++ == 0) {
+			__hset_mark(h, dest);
+		}
+		if (h->filter.blocks != NULL) {
+			bloom_add_hashed(&h->filter, next->hash);
+		}
 		next = tmp;
 	}
 
 	b->first = NULL;
+	b->size = 0;
+	__hset_mark(h, b);
+}
+
+/* bucket by iteration index, old buckets come before the new table */
+static struct bucket* __iter_bucket(hash_set_t *h, size_t index)
+{
+	if (index < h->old_bucket_size) {
+		return &h->old_buckets[index];
+	}
+
+	return &h->buckets[index - h->old_bucket_size];
+}
+
+/* bucket array followed by its zeroed occupancy bitmap */
+static struct bucket* __hset_alloc_buckets(size_t bucket_size)
+{
+	size_t bytes = sizeof(struct bucket) * bucket_size +
+		sizeof(uint64) * ((bucket_size + 63) / 64);
+	struct bucket *buckets = malloc(bytes);
+	assert(buckets);
+	memset(buckets, 0, bytes);
+	return buckets;
+}
+
+/* updates the occupancy bit of b, which is in the new or the old table */
+static void __hset_mark(hash_set_t *h, struct bucket *b)
+{
+	uint64 *bitmap;
+	size_t i;
+	if (b >= h->buckets && b < h->buckets + h->bucket_size) {
+		bitmap = __bucket_bitmap(h->buckets, h->bucket_size);
+		i = b - h->buckets;
+	} else {
+		bitmap = __bucket_bitmap(h->old_buckets, h->old_bucket_size);
+		i = b - h->old_buckets;
+	}
+
+	if (b->size > 0) {
+		bitmap[i / 64] |= (uint64)1 << (i % 64);
+	} else {
+		bitmap[i / 64] &= ~((uint64)1 << (i % 64));
+	}
+}
+
+/* first set bit at or after index, n if none */
+static size_t __bitmap_next(uint64 *bitmap, size_t index, size_t n)
+{
+	while (index < n) {
+		uint64 word = bitmap[index / 64] & (~(uint64)0 << (index % 64));
+		if (word) {
+			return index / 64 * 64 + __builtin_ctzll(word);
+		}
+		index = (index / 64 + 1) * 64;
+	}
+
+	return n;
+}
+
+/* iteration index of the first occupied bucket at or after index */
+static size_t __hset_next_bucket(hash_set_t *h, size_t index)
+{
+	if (index < h->old_bucket_size) {
+		index = __bitmap_next(__bucket_bitmap(h->old_buckets,
+					h->old_bucket_size), index, h->old_bucket_size);
+		if (index < h->old_bucket_size) {
+			return index;
+		}
+	}
+
+	return h->old_bucket_size + __bitmap_next(
+			__bucket_bitmap(h->buckets, h->bucket_size),
+			index - h->old_bucket_size, h->bucket_size);
+}
+
+/* frees the old table and its filter */
+static void __hset_end_migration(hash_set_t *h)
+{
+	free(h->old_buckets);
+	h->old_buckets = NULL;
+	h->old_bucket_size = 0;
+	h->rehash_index = 0;
+	bloom_destroy(&h->old_filter);
+}
+
+/* initializes h with the configuration of src, sized for n elements */
+static void __hset_init_like(hash_set_t *h, hash_set_t *src, size_t n)
+{
+	if (src->key_size) {
+		hset_init(h, src->elem_size, src->copy, src->free, src->compare);
+		h->key_size = src->key_size;
+	} else {
+		hset_init_bytes(h);
+	}
+	h->hash = src->hash;
+	h->flags = src->flags;
+	h->max_load_factor = src->max_load_factor;
+	__hset_set_limits(h);
+	hset_reserve(h, n);
+}
+
+/*
+ * copies the nodes of src found in other (keep_found) or missing from it
+ * into dest, whose keys must be disjoint from them. the probing runs on
+ * up to threads threads, neither src nor other is modified.
+ */
+static void __hset_select(hash_set_t *dest, hash_set_t *src,
+		hash_set_t *other, int keep_found, size_t threads)
+{
+	assert(other && other->key_size == src->key_size &&
+			other->compare == src->compare);
+
+	size_t end = src->old_bucket_size + src->bucket_size;
+	if (threads < 1) {
+		threads = 1;
+	} else if (threads > end / DEFAULT_CONTAINER_CAPACITY) {
+		threads = end / DEFAULT_CONTAINER_CAPACITY;
+	}
+
+	struct hset_select_task *tasks =
+		calloc(threads, sizeof(struct hset_select_task));
+	pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+	assert(tasks && tids);
+
+	size_t i;
+	for (i = 0; i < threads; i++) {
+		tasks[i].src = src;
+		tasks[i].other = other;
+		tasks[i].keep_found = keep_found;
+		tasks[i].first = end / threads * i;
+		tasks[i].last = (i + 1 < threads) ? end / threads * (i + 1) : end;
+	}
+
+	/* the calling thread takes the first range, a failed thread runs inline */
+	int *started = calloc(threads, sizeof(int));
+	assert(started);
+	for (i = 1; i < threads; i++) {
+		started[i] = !pthread_create(&tids[i], NULL,
+				__hset_select_range, &tasks[i]);
+	}
+	__hset_select_range(&tasks[0]);
+
+	for (i = 0; i < threads; i++) {
+		if (started[i]) {
+			pthread_join(tids[i], NULL);
+		} else if (i > 0) {
+			__hset_select_range(&tasks[i]);
+		}
+
+		size_t j;
+		for (j = 0; j < tasks[i].size; j++) {
+			__hset_copy_node(dest, tasks[i].nodes[j]);
+		}
+		free(tasks[i].nodes);
+	}
+
+	free(started);
+	free(tids);
+	free(tasks);
+}
+
+static void* __hset_select_range(void *arg)
+{
+	struct hset_select_task *t = arg;
+	hash_set_t *src = t->src;
+
+	size_t i;
+	for (i = __hset_next_bucket(src, t->first); i < t->last;
+			i = __hset_next_bucket(src, i + 1)) {
+		struct chain_node *n;
+		for (n = __iter_bucket(src, i)->first; n != NULL; n = n->next) {
+			int found;
+			struct bucket *b;
+			if (src->key_size) {
+				found = __hset_lookup(t->other, n->data,
+						src->key_size, n->hash, &b) != NULL;
+			} else {
+				struct bytes_key *k = (struct bytes_key *)n->data;
+				found = __hset_lookup(t->other, k->bytes,
+						k->length, n->hash, &b) != NULL;
+			}
+			if (found != t->keep_found) {
+				continue;
+			}
+
+			if (t->size == t->capacity) {
+				t->capacity = t->capacity ? t->capacity * 2 :
+					DEFAULT_CONTAINER_CAPACITY;
+				t->nodes = realloc(t->nodes,
+						sizeof(struct chain_node *) * t->capacity);
+				assert(t->nodes);
+			}
+			t->nodes[t->size++] = n;
+		}
+	}
+
+	return NULL;
+}
+
+/* links a copy of every node of src, dest must hold none of its keys */
+static void __hset_copy_all(hash_set_t *dest, hash_set_t *src)
+{
+	size_t i;
+	size_t end = src->old_bucket_size + src->bucket_size;
+	for (i = __hset_next_bucket(src, 0); i < end;
+			i = __hset_next_bucket(src, i + 1)) {
+		struct chain_node *n;
+		for (n = __iter_bucket(src, i)->first; n != NULL; n = n->next) {
+			__hset_copy_node(dest, n);
+		}
+	}
+}
+
+/* links a copy of node n of another set, its key must not be in h */
+static void __hset_copy_node(hash_set_t *h, struct chain_node *n)
+{
+	struct chain_node *copy;
+	if (h->key_size) {
+		copy = __hset_alloc_node(h);
+		CONTAINER_COPY(copy->data, n->data, h);
+	} else {
+		struct bytes_key *k = (struct bytes_key *)n->data;
+		copy = __hset_alloc_bytes_node(h, __bytes_node_size(k->length));
+		memcpy(copy->data, k, sizeof(struct bytes_key) + k->length + 1);
+	}
+
+	copy->hash = n->hash;
+	__hset_link_node(h, copy);
 }
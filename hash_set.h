@@ -6,19 +6,41 @@
 #include "util_define.h"
 #include "iterator.h"
 #include "hash.h"
+#include "bloom_filter.h"
 
-#define MAX_BUCKET_CAPACITY	11
-#define EQUALS(e1, e2, h)	(h->compare) ?	\
-	(!h->compare(e1, e2)) : (!memcmp(e1, e2, h->key_size))
+#define HSET_MAX_LOAD_FACTOR	1.0f	/* default elements per bucket */
+#define EQUALS(e1, e2, h)	((h)->compare ?	\
+	!(h)->compare(e1, e2) : !memcmp(e1, e2, (h)->key_size))
 #define HSET_INIT(h, elem_size)	hset_init((h), (elem_size), NULL, NULL, NULL)
+#define HSET_REHASH_BUCKETS	4	/* buckets migrated by each update */
+#define HSET_BATCH_SIZE	16	/* lookups in flight in the batch functions */
+#define HSET_SLAB_MAX_NODES	4096	/* nodes in the largest slab */
+#define HSET_BYTES_CLASSES	64	/* reused byte key node sizes, 8 apart */
+
+/* hash set flags */
+#define HSET_INCREMENTAL	0x1	/* migrate buckets gradually on resize */
+#define HSET_AUTO_SHRINK	0x2	/* halve the buckets when mostly empty */
 
 typedef struct hash_set hash_set_t;
 
 struct chain_node {
 	struct chain_node *next;
+	uint64 hash;		/* full hash of the key */
 	char data[0];
 };
 
+/* chain nodes are carved from slabs, which are only freed by hset_clear */
+struct node_slab {
+	struct node_slab *next;
+	char nodes[0];
+};
+
+/* element of a set of variable length keys, bytes is NUL terminated */
+struct bytes_key {
+	uint32 length;
+	char bytes[0];
+};
+
 struct bucket {
 	struct chain_node *first;
 	size_t size;
@@ -27,15 +49,29 @@ struct bucket {
 struct hash_set {
 	struct bucket *buckets;
 	size_t elem_size;
-	size_t key_size;
+	size_t key_size;		/* 0 for variable length keys */
 	size_t size;
-	size_t bucket_size;
-	size_t max_bucket_capacity;
-	int has_long_chain;
-	size_t long_chain_index;
+	size_t bucket_size;		/* always a power of two */
+	float max_load_factor;
+	size_t grow_size;		/* grow above this many elements */
+	size_t shrink_size;		/* shrink below this many elements */
+	unsigned int flags;
+	struct bucket *old_buckets;	/* table being migrated, or NULL */
+	size_t old_bucket_size;
+	size_t rehash_index;		/* next old bucket to migrate */
+	size_t node_size;		/* chain node plus element, aligned */
+	struct node_slab *slabs;
+	char *slab_next;		/* unused part of the newest slab */
+	char *slab_end;
+	size_t slab_nodes;		/* nodes in the next slab */
+	struct chain_node *free_nodes;	/* erased nodes for reuse */
+	struct chain_node **free_bytes;	/* erased byte key nodes by size */
+	bloom_filter_t filter;		/* optional guard for lookups */
+	bloom_filter_t old_filter;	/* guard of the old table */
 	void (*copy)(void *dest, void *src);
 	void (*free)(void *element);
 	int (*compare)(void *e1, void *e2);
+	uint64 (*hash)(const void *key, size_t length);
 	void (*iter_head)(iterator_t *it, hash_set_t *h);
 	void (*iter_next)(iterator_t *it, hash_set_t *h);
 };
@@ -45,10 +81,32 @@ void hset_init(hash_set_t *h, size_t elem_size,
 		void (*copy_func)(void *, void *),
 		void (*free_func)(void *),
 		int (*cmp_func)(void *, void *));
+void hset_init_bytes(hash_set_t *h);
 void hset_clear(hash_set_t *h);
 void hset_insert(hash_set_t *h, void *key);
 void hset_erase(hash_set_t *h, void *key);
 void hset_find(hash_set_t *h, void *key, iterator_t *it);
+void hset_insert_hashed(hash_set_t *h, void *key, uint64 hashval);
+void hset_find_hashed(hash_set_t *h, void *key, uint64 hashval,
+		iterator_t *it);
+void* hset_find_or_insert(hash_set_t *h, void *key, int *inserted);
+void hset_insert_batch(hash_set_t *h, void *elements, size_t n);
+void hset_find_batch(hash_set_t *h, void *keys, size_t n, void **results);
+void hset_insert_bytes(hash_set_t *h, const void *bytes, size_t length);
+void hset_erase_bytes(hash_set_t *h, const void *bytes, size_t length);
+void hset_find_bytes(hash_set_t *h, const void *bytes, size_t length,
+		iterator_t *it);
+int hset_rehash_step(hash_set_t *h, size_t budget);
+void hset_reserve(hash_set_t *h, size_t n);
+void hset_shrink_to_fit(hash_set_t *h);
+void hset_set_max_load_factor(hash_set_t *h, float max_load_factor);
+void hset_set_filter(hash_set_t *h, size_t bits_per_key);
+void hset_union(hash_set_t *dest, hash_set_t *h1, hash_set_t *h2,
+		size_t threads);
+void hset_intersect(hash_set_t *dest, hash_set_t *h1, hash_set_t *h2,
+		size_t threads);
+void hset_difference(hash_set_t *dest, hash_set_t *h1, hash_set_t *h2,
+		size_t threads);
 
 /* destroy the hash set */
 static inline void hset_destroy(hash_set_t *h)
@@ -57,6 +115,38 @@ static inline void hset_destroy(hash_set_t *h)
 	hset_clear(h);
 	free(h->buckets);
 	h->buckets = NULL;
+	free(h->free_bytes);
+	h->free_bytes = NULL;
+	bloom_destroy(&h->filter);
+}
+
+/* sets the hash set flags, e.g. HSET_INCREMENTAL */
+static inline void hset_set_flags(hash_set_t *h, unsigned int flags)
+{
+	assert(h);
+	h->flags = flags;
+}
+
+/* checks whether a resize is still migrating buckets */
+static inline int hset_rehashing(hash_set_t *h)
+{
+	assert(h);
+	return h->old_buckets != NULL;
+}
+
+/* returns the hash of key, for hset_insert_hashed and hset_find_hashed */
+static inline uint64 hset_hash(hash_set_t *h, void *key)
+{
+	assert(h && key && h->key_size);
+	return h->hash(key, h->key_size);
+}
+
+/* replaces the hash function (hash64 by default), the set must be empty */
+static inline void hset_set_hash(hash_set_t *h,
+		uint64 (*hash_func)(const void *, size_t))
+{
+	assert(h && hash_func && !h->size);
+	h->hash = hash_func;
 }
 
 /* checks whether the hash set is empty */
@@ -79,6 +169,7 @@ static inline void __set_key_size(hash_set_t *h, size_t key_size)
 	h->key_size = key_size;
 }
 
+/* returns the node to the free list of the hash set */
 static inline void __free_chain_node(hash_set_t *h, struct chain_node *n)
 {
 	assert(h && n);
@@ -86,7 +177,8 @@ static inline void __free_chain_node(hash_set_t *h, struct chain_node *n)
 		h->free(n->data);
 	}
 
-	free(n);
+	n->next = h->free_nodes;
+	h->free_nodes = n;
 }
 
 #endif
@@ -65,4 +65,18 @@ static inline void queue_pop(queue_t *q)
 	deque_pop_front(&q->d);
 }
 
+/* inserts n elements at the end */
+static inline void queue_push_n(queue_t *q, void *elements, size_t n)
+{
+	assert(q && (elements || !n));
+	deque_push_back_n(&q->d, elements, n);
+}
+
+/* moves up to max elements from the front to out, returns how many */
+static inline size_t queue_drain(queue_t *q, void *out, size_t max)
+{
+	assert(q && out);
+	return deque_pop_front_n(&q->d, out, max);
+}
+
 #endif
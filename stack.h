@@ -51,6 +51,23 @@ static inline void stack_pop(stack_t *s)
 	deque_pop_back(&s->d);
 }
 
+/* inserts n elements at the top, the last one ends up on top */
+static inline void stack_push_n(stack_t *s, void *elements, size_t n)
+{
+	assert(s && (elements || !n));
+	deque_push_back_n(&s->d, elements, n);
+}
+
+/*
+ * removes up to n top elements and returns how many. if out is not NULL
+ * they are moved there in push order, the old top last
+ */
+static inline size_t stack_pop_n(stack_t *s, void *out, size_t n)
+{
+	assert(s);
+	return deque_pop_back_n(&s->d, out, n);
+}
+
 /* access the top element */
 static inline void* stack_top(stack_t *s)
 {
@@ -0,0 +1,194 @@
+#ifndef _TYPED_DEQUE_H_
+#define _TYPED_DEQUE_H_
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util_define.h"
+
+#define TYPED_BLOCK_CAPACITY	512
+
+/*
+ * DEQUE_DECLARE(name, type) generates a deque specialized for type with the
+ * semantics of the deque_* functions: elements live in fixed size blocks
+ * and never move on push or pop. The block capacity is a compile time
+ * constant, so deque_at is a shift and a mask for most element types.
+ */
+#define DEQUE_DECLARE(name, type)					\
+									\
+typedef struct name name##_t;						\
+									\
+struct name {								\
+	type **map;		/* block pointers */			\
+	size_t map_capacity;						\
+	size_t first_block;	/* map index of the first block */	\
+	size_t blocks;		/* number of blocks in use */		\
+	size_t begin;		/* first element in the first block */	\
+	size_t size;							\
+};									\
+									\
+/* initialize deque */							\
+static inline void name##_init(name##_t *d)				\
+{									\
+	assert(d);							\
+	memset(d, 0, sizeof(name##_t));					\
+}									\
+									\
+/* clears the contents */						\
+static inline void name##_clear(name##_t *d)				\
+{									\
+	assert(d);							\
+									\
+	size_t i;							\
+	for (i = 0; i < d->blocks; i++) {				\
+		free(d->map[d->first_block + i]);			\
+	}								\
+	d->first_block = d->map_capacity / 2;				\
+	d->blocks = 0;							\
+	d->begin = 0;							\
+	d->size = 0;							\
+}									\
+									\
+/* destroy deque, free memory */					\
+static inline void name##_destroy(name##_t *d)				\
+{									\
+	assert(d);							\
+	name##_clear(d);						\
+	free(d->map);							\
+	memset(d, 0, sizeof(name##_t));					\
+}									\
+									\
+/* check whether the container is empty */				\
+static inline int name##_empty(name##_t *d)				\
+{									\
+	assert(d);							\
+	return !d->size;						\
+}									\
+									\
+/* return the number of elements */					\
+static inline size_t name##_size(name##_t *d)				\
+{									\
+	assert(d);							\
+	return d->size;							\
+}									\
+									\
+/* access specified element with bounds checking */			\
+static inline type* name##_at(name##_t *d, size_t position)		\
+{									\
+	assert(d && position < d->size);				\
+									\
+	size_t i = d->begin + position;					\
+	return &d->map[d->first_block + i / TYPED_BLOCK_CAPACITY]	\
+		[i % TYPED_BLOCK_CAPACITY];				\
+}									\
+									\
+/* access the first element */						\
+static inline type* name##_front(name##_t *d)				\
+{									\
+	assert(d);							\
+	return name##_at(d, 0);						\
+}									\
+									\
+/* access the last element */						\
+static inline type* name##_back(name##_t *d)				\
+{									\
+	assert(d);							\
+	return name##_at(d, d->size - 1);				\
+}									\
+									\
+/* makes room in the map for one more block at the front or back */	\
+static inline void __##name##_map_reserve(name##_t *d, int at_front)	\
+{									\
+	if (at_front ? d->first_block > 0 :				\
+			d->first_block + d->blocks < d->map_capacity) {	\
+		return;							\
+	}								\
+									\
+	/* grow only when the map is more than half full, else recentre */	\
+	size_t capacity = d->map_capacity;				\
+	type **map = d->map;						\
+	if (capacity == 0 || (d->blocks + 1) * 2 > capacity) {		\
+		capacity = capacity ? capacity * 2 : DEFAULT_CONTAINER_CAPACITY;	\
+		map = malloc(sizeof(type *) * capacity);		\
+		assert(map);						\
+	}								\
+									\
+	size_t first = (capacity - d->blocks - 1) / 2 + (at_front ? 1 : 0);	\
+	if (d->blocks > 0) {						\
+		memmove(map + first, d->map + d->first_block,		\
+				sizeof(type *) * d->blocks);		\
+	}								\
+	if (map != d->map) {						\
+		free(d->map);						\
+		d->map = map;						\
+		d->map_capacity = capacity;				\
+	}								\
+	d->first_block = first;						\
+}									\
+									\
+/* inserts elements to the end */					\
+static inline void name##_push_back(name##_t *d, type *element)	\
+{									\
+	assert(d && element);						\
+									\
+	type tmp = *element;						\
+	size_t i = d->begin + d->size;					\
+	if (i == d->blocks * TYPED_BLOCK_CAPACITY) {			\
+		__##name##_map_reserve(d, 0);				\
+		type *b = malloc(sizeof(type) * TYPED_BLOCK_CAPACITY);	\
+		assert(b);						\
+		d->map[d->first_block + d->blocks++] = b;		\
+	}								\
+									\
+	d->map[d->first_block + i / TYPED_BLOCK_CAPACITY]		\
+		[i % TYPED_BLOCK_CAPACITY] = tmp;			\
+	d->size++;							\
+}									\
+									\
+/* removes the last element */						\
+static inline void name##_pop_back(name##_t *d)			\
+{									\
+	assert(d && !name##_empty(d));					\
+									\
+	if (--d->size == 0) {						\
+		name##_clear(d);					\
+	} else if (d->begin + d->size <=				\
+			(d->blocks - 1) * TYPED_BLOCK_CAPACITY) {	\
+		free(d->map[d->first_block + --d->blocks]);		\
+	}								\
+}									\
+									\
+/* inserts elements to the beginning */					\
+static inline void name##_push_front(name##_t *d, type *element)	\
+{									\
+	assert(d && element);						\
+									\
+	type tmp = *element;						\
+	if (d->begin == 0) {						\
+		__##name##_map_reserve(d, 1);				\
+		type *b = malloc(sizeof(type) * TYPED_BLOCK_CAPACITY);	\
+		assert(b);						\
+		d->map[--d->first_block] = b;				\
+		d->blocks++;						\
+		d->begin = TYPED_BLOCK_CAPACITY;			\
+	}								\
+									\
+	d->begin--;							\
+	d->map[d->first_block][d->begin] = tmp;				\
+	d->size++;							\
+}									\
+									\
+/* removes the first element */						\
+static inline void name##_pop_front(name##_t *d)			\
+{									\
+	assert(d && !name##_empty(d));					\
+									\
+	if (--d->size == 0) {						\
+		name##_clear(d);					\
+	} else if (++d->begin == TYPED_BLOCK_CAPACITY) {		\
+		free(d->map[d->first_block++]);				\
+		d->blocks--;						\
+		d->begin = 0;						\
+	}								\
+}
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef _TYPED_HASH_SET_H_
+#define _TYPED_HASH_SET_H_
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util_define.h"
+#include "iterator.h"
+#include "hash.h"
+
+/* default hash and equality for plain old data keys */
+#define HSET_HASH_BYTES(k)		hash64((k), sizeof(*(k)))
+#define HSET_EQUALS_BYTES(k1, k2)	(!memcmp((k1), (k2), sizeof(*(k1))))
+
+/*
+ * HSET_DECLARE(name, type, hash_func, equals_func) generates a hash set of
+ * type with the semantics of the hset_* functions. hash_func(type *) and
+ * equals_func(type *, type *) may be macros or static inline functions,
+ * e.g. HSET_HASH_BYTES and HSET_EQUALS_BYTES, so they are inlined into the
+ * chain walks. The bucket count is a power of two and the table doubles
+ * when it holds more elements than buckets.
+ */
+#define HSET_DECLARE(name, type, hash_func, equals_func)		\
+									\
+typedef struct name name##_t;						\
+									\
+struct name##_node {							\
+	struct name##_node *next;					\
+	type key;							\
+};									\
+									\
+struct name {								\
+	struct name##_node **buckets;					\
+	size_t bucket_size;						\
+	size_t size;							\
+};									\
+									\
+/* initialize the hash set */						\
+static inline void name##_init(name##_t *h)				\
+{									\
+	assert(h);							\
+									\
+	h->bucket_size = DEFAULT_CONTAINER_CAPACITY;			\
+	h->buckets = calloc(h->bucket_size, sizeof(struct name##_node *));	\
+	assert(h->buckets);						\
+	h->size = 0;							\
+}									\
+									\
+/* remove all elements */						\
+static inline void name##_clear(name##_t *h)				\
+{									\
+	assert(h);							\
+									\
+	size_t i;							\
+	for (i = 0; i < h->bucket_size; i++) {				\
+		struct name##_node *next = h->buckets[i];		\
+		while (next != NULL) {					\
+			struct name##_node *tmp = next->next;		\
+			free(next);					\
+			next = tmp;					\
+		}							\
+		h->buckets[i] = NULL;					\
+	}								\
+	h->size = 0;							\
+}									\
+									\
+/* destroy the hash set */						\
+static inline void name##_destroy(name##_t *h)				\
+{									\
+	assert(h);							\
+	name##_clear(h);						\
+	free(h->buckets);						\
+	h->buckets = NULL;						\
+	h->bucket_size = 0;						\
+}									\
+									\
+/* checks whether the hash set is empty */				\
+static inline int name##_empty(name##_t *h)				\
+{									\
+	assert(h);							\
+	return !h->size;						\
+}									\
+									\
+/* return the number of elements */					\
+static inline size_t name##_size(name##_t *h)				\
+{									\
+	assert(h);							\
+	return h->size;							\
+}									\
+									\
+/* doubles the bucket array, nodes are relinked and not copied */	\
+static inline void __##name##_expand(name##_t *h)			\
+{									\
+	size_t bucket_size = h->bucket_size * 2;			\
+	struct name##_node **buckets =					\
+		calloc(bucket_size, sizeof(struct name##_node *));	\
+	assert(buckets);						\
+									\
+	size_t i;							\
+	for (i = 0; i < h->bucket_size; i++) {				\
+		struct name##_node *next = h->buckets[i];		\
+		while (next != NULL) {					\
+			struct name##_node *tmp = next->next;		\
+			size_t bkt_index = (size_t)hash_func(&next->key) &	\
+				(bucket_size - 1);			\
+			next->next = buckets[bkt_index];		\
+			buckets[bkt_index] = next;			\
+			next = tmp;					\
+		}							\
+	}								\
+									\
+	free(h->buckets);						\
+	h->buckets = buckets;						\
+	h->bucket_size = bucket_size;					\
+}									\
+									\
+/* inserts elements */							\
+static inline void name##_insert(name##_t *h, type *key)		\
+{									\
+	assert(h && key && h->buckets);					\
+									\
+	size_t bkt_index = (size_t)hash_func(key) & (h->bucket_size - 1);	\
+	struct name##_node *next = h->buckets[bkt_index];		\
+	while (next != NULL) {						\
+		if (equals_func(&next->key, key)) {			\
+			return;						\
+		}							\
+		next = next->next;					\
+	}								\
+									\
+	struct name##_node *n = malloc(sizeof(struct name##_node));	\
+	assert(n);							\
+	n->key = *key;							\
+	n->next = h->buckets[bkt_index];				\
+	h->buckets[bkt_index] = n;					\
+	if (++h->size > h->bucket_size) {				\
+		__##name##_expand(h);					\
+	}								\
+}									\
+									\
+/* erases elements */							\
+static inline void name##_erase(name##_t *h, type *key)		\
+{									\
+	assert(h && key && h->buckets);					\
+									\
+	size_t bkt_index = (size_t)hash_func(key) & (h->bucket_size - 1);	\
+	struct name##_node **link = &h->buckets[bkt_index];		\
+	while (*link != NULL) {						\
+		struct name##_node *next = *link;			\
+		if (equals_func(&next->key, key)) {			\
+			*link = next->next;				\
+			free(next);					\
+			h->size--;					\
+			return;						\
+		}							\
+		link = &next->next;					\
+	}								\
+}									\
+									\
+/* finds element with specific key */					\
+static inline void name##_find(name##_t *h, type *key, iterator_t *it)	\
+{									\
+	assert(h && key && it);						\
+									\
+	it->ptr = NULL;							\
+	if (h->buckets == NULL) {					\
+		return;							\
+	}								\
+									\
+	size_t bkt_index = (size_t)hash_func(key) & (h->bucket_size - 1);	\
+	struct name##_node *next = h->buckets[bkt_index];		\
+	while (next != NULL) {						\
+		if (equals_func(&next->key, key)) {			\
+			it->ptr = next;					\
+			it->data = &next->key;				\
+			it->key = it->data;				\
+			it->bkt_index = bkt_index;			\
+			return;						\
+		}							\
+		next = next->next;					\
+	}								\
+}
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef _TYPED_PRIORITY_QUEUE_H_
+#define _TYPED_PRIORITY_QUEUE_H_
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typed_vector.h"
+
+#ifndef parent
+#define parent(x)	((x - 1) / 2)
+#define lchild(x)	(2 * x + 1)
+#define rchild(x)	(2 * x + 2)
+#endif
+
+/*
+ * PQUEUE_DECLARE(name, type, cmp_func) generates a priority queue of type
+ * with the semantics of the pqueue_* functions. cmp_func(type *, type *)
+ * may be a macro or a static inline function, it is expanded in the heap
+ * loops instead of being called through a pointer. The underlying vector
+ * is declared as name_vec.
+ */
+#define PQUEUE_DECLARE(name, type, cmp_func)				\
+									\
+VECTOR_DECLARE(name##_vec, type)					\
+									\
+typedef struct name name##_t;						\
+									\
+struct name {								\
+	name##_vec_t v;							\
+};									\
+									\
+/* initialize the priority queue */					\
+static inline void name##_init(name##_t *q)				\
+{									\
+	assert(q);							\
+	name##_vec_init(&q->v);						\
+}									\
+									\
+/* destroy the priority queue */					\
+static inline void name##_destroy(name##_t *q)				\
+{									\
+	assert(q);							\
+	name##_vec_destroy(&q->v);					\
+}									\
+									\
+/* checks whether the underlying container is empty */			\
+static inline int name##_empty(name##_t *q)				\
+{									\
+	assert(q);							\
+	return name##_vec_empty(&q->v);					\
+}									\
+									\
+/* returns the number of elements */					\
+static inline size_t name##_size(name##_t *q)				\
+{									\
+	assert(q);							\
+	return name##_vec_size(&q->v);					\
+}									\
+									\
+/* access the top element */						\
+static inline type* name##_top(name##_t *q)				\
+{									\
+	assert(q && !name##_empty(q));					\
+	return q->v.array;						\
+}									\
+									\
+/* inserts element and sorts the underlying container */		\
+static inline void name##_push(name##_t *q, type *element)		\
+{									\
+	assert(q && element);						\
+									\
+	size_t x = q->v.size;						\
+	name##_vec_push_back(&q->v, element);				\
+									\
+	type *a = q->v.array;						\
+	type tmp = a[x];						\
+	while (x > 0 && cmp_func(&a[parent(x)], &tmp) < 0) {		\
+		a[x] = a[parent(x)];					\
+		x = parent(x);						\
+	}								\
+	a[x] = tmp;							\
+}									\
+									\
+/* removes the first element */						\
+static inline void name##_pop(name##_t *q)				\
+{									\
+	assert(q && !name##_empty(q));					\
+									\
+	type *a = q->v.array;						\
+	size_t size = --q->v.size;					\
+	if (size == 0) {						\
+		return;							\
+	}								\
+									\
+	type tmp = a[size];						\
+	size_t cur = 0;							\
+	while (lchild(cur) < size) {					\
+		size_t largest = lchild(cur);				\
+		if (largest + 1 < size &&				\
+				cmp_func(&a[largest + 1], &a[largest]) > 0) {	\
+			largest++;					\
+		}							\
+									\
+		if (cmp_func(&a[largest], &tmp) <= 0) {			\
+			break;						\
+		}							\
+									\
+		a[cur] = a[largest];					\
+		cur = largest;						\
+	}								\
+	a[cur] = tmp;							\
+}
+
+#endif
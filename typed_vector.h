@@ -0,0 +1,248 @@
+#ifndef _TYPED_VECTOR_H_
+#define _TYPED_VECTOR_H_
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util_define.h"
+
+/*
+ * VECTOR_DECLARE(name, type) generates a vector specialized for type:
+ * struct name / name_t and name_init, name_destroy, name_at, name_push_back...
+ * with the same semantics as the vector_* functions. The element size is a
+ * compile time constant and elements are copied by assignment, so the type
+ * must be plain old data.
+ */
+#define VECTOR_DECLARE(name, type)					\
+									\
+typedef struct name name##_t;						\
+									\
+struct name {								\
+	type *array;							\
+	size_t capacity;						\
+	size_t size;							\
+};									\
+									\
+/* initialize the vector, storage is allocated by the first insertion */	\
+static inline void name##_init(name##_t *v)				\
+{									\
+	assert(v);							\
+	memset(v, 0, sizeof(name##_t));					\
+}									\
+									\
+/* destroy vector, free memory */					\
+static inline void name##_destroy(name##_t *v)				\
+{									\
+	assert(v);							\
+	free(v->array);							\
+	memset(v, 0, sizeof(name##_t));					\
+}									\
+									\
+/* checks whether the container is empty */				\
+static inline int name##_empty(name##_t *v)				\
+{									\
+	assert(v);							\
+	return !v->size;						\
+}									\
+									\
+/* returns the number of elements */					\
+static inline size_t name##_size(name##_t *v)				\
+{									\
+	assert(v);							\
+	return v->size;							\
+}									\
+									\
+/* returns the number of elements that can be held */			\
+static inline size_t name##_capacity(name##_t *v)			\
+{									\
+	assert(v);							\
+	return v->capacity;						\
+}									\
+									\
+/* access specified element with bounds checking */			\
+static inline type* name##_at(name##_t *v, size_t position)		\
+{									\
+	assert(v && position < v->size);				\
+	return &v->array[position];					\
+}									\
+									\
+/* access the first element */						\
+static inline type* name##_front(name##_t *v)				\
+{									\
+	assert(v);							\
+	return name##_at(v, 0);						\
+}									\
+									\
+/* access the last element */						\
+static inline type* name##_back(name##_t *v)				\
+{									\
+	assert(v && v->size);						\
+	return name##_at(v, v->size - 1);				\
+}									\
+									\
+/* reserves storage */							\
+static inline void name##_reserve(name##_t *v, size_t n)		\
+{									\
+	assert(v && n >= v->size);					\
+									\
+	if (v->capacity == n) {						\
+		return;							\
+	}								\
+									\
+	if (n == 0) {							\
+		free(v->array);						\
+		v->array = NULL;					\
+	} else {							\
+		v->array = realloc(v->array, n * sizeof(type));		\
+		assert(v->array);					\
+	}								\
+	v->capacity = n;						\
+}									\
+									\
+/* makes room for n more elements, at most one reallocation */		\
+static inline void __##name##_grow(name##_t *v, size_t n)		\
+{									\
+	size_t need = v->size + n;					\
+	if (need <= v->capacity) {					\
+		return;							\
+	}								\
+									\
+	size_t capacity = v->capacity ?					\
+		v->capacity * 2 : DEFAULT_CONTAINER_CAPACITY;		\
+	if (capacity < need) {						\
+		capacity = need;					\
+	}								\
+	name##_reserve(v, capacity);					\
+}									\
+									\
+/* resizes storage, set extended storage to zero */			\
+static inline void name##_resize(name##_t *v, size_t n)		\
+{									\
+	assert(v && n >= v->size);					\
+									\
+	name##_reserve(v, n);						\
+	if (n > v->size) {						\
+		memset(v->array + v->size, 0,				\
+				(n - v->size) * sizeof(type));		\
+	}								\
+	v->size = n;							\
+}									\
+									\
+/* reduces the capacity to the number of elements */			\
+static inline void name##_shrink_to_fit(name##_t *v)			\
+{									\
+	assert(v);							\
+	name##_reserve(v, v->size);					\
+}									\
+									\
+/* inserts elements */							\
+static inline void name##_insert(name##_t *v, type *element,		\
+		size_t position)					\
+{									\
+	assert(v && element && position <= v->size);			\
+									\
+	type tmp = *element;						\
+	__##name##_grow(v, 1);						\
+	if (position < v->size) {					\
+		memmove(v->array + position + 1, v->array + position,	\
+				(v->size - position) * sizeof(type));	\
+	}								\
+	v->array[position] = tmp;					\
+	v->size++;							\
+}									\
+									\
+/* inserts n contiguous elements at position */			\
+static inline void name##_insert_range(name##_t *v, type *elements,	\
+		size_t n, size_t position)				\
+{									\
+	assert(v && position <= v->size);				\
+									\
+	if (n == 0) {							\
+		return;							\
+	}								\
+									\
+	assert(elements);						\
+	__##name##_grow(v, n);						\
+	if (position < v->size) {					\
+		memmove(v->array + position + n, v->array + position,	\
+				(v->size - position) * sizeof(type));	\
+	}								\
+	memcpy(v->array + position, elements, n * sizeof(type));	\
+	v->size += n;							\
+}									\
+									\
+/* inserts elements to the end */					\
+static inline void name##_push_back(name##_t *v, type *element)	\
+{									\
+	assert(v && element);						\
+									\
+	type tmp = *element;						\
+	if (v->size == v->capacity) {					\
+		__##name##_grow(v, 1);					\
+	}								\
+	v->array[v->size++] = tmp;					\
+}									\
+									\
+/* appends n contiguous elements to the end */				\
+static inline void name##_append_n(name##_t *v, type *elements,	\
+		size_t n)						\
+{									\
+	assert(v);							\
+	name##_insert_range(v, elements, n, v->size);			\
+}									\
+									\
+/* removes the last element */						\
+static inline void name##_pop_back(name##_t *v)			\
+{									\
+	assert(v && !name##_empty(v));					\
+	v->size--;							\
+}									\
+									\
+/* replaces specified element */					\
+static inline void name##_replace(name##_t *v, type *element,		\
+		size_t position)					\
+{									\
+	assert(v && element && position < v->size);			\
+	v->array[position] = *element;					\
+}									\
+									\
+/* deletes element */							\
+static inline void name##_delete(name##_t *v, size_t position)		\
+{									\
+	assert(v && position < v->size);				\
+									\
+	memmove(v->array + position, v->array + position + 1,		\
+			(v->size - position - 1) * sizeof(type));	\
+	v->size--;							\
+}									\
+									\
+/* erases elements in range [first, last) */				\
+static inline void name##_erase_range(name##_t *v, size_t first,	\
+		size_t last)						\
+{									\
+	assert(v && first <= last && last <= v->size);			\
+									\
+	if (first == last) {						\
+		return;							\
+	}								\
+									\
+	memmove(v->array + first, v->array + last,			\
+			(v->size - last) * sizeof(type));		\
+	v->size -= last - first;					\
+}									\
+									\
+/* clears the contents */						\
+static inline void name##_clear(name##_t *v)				\
+{									\
+	assert(v);							\
+	v->size = 0;							\
+}									\
+									\
+/* replaces the contents with n contiguous elements */			\
+static inline void name##_assign(name##_t *v, type *elements, size_t n)	\
+{									\
+	assert(v);							\
+	name##_clear(v);						\
+	name##_insert_range(v, elements, n, 0);				\
+}
+
+#endif
@@ -1,10 +1,35 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "vector.h"
 
+#define VECTOR_FILE_MAGIC	"CUTILVEC"
+#define VECTOR_FILE_VERSION	1
+
+/* header of a saved vector, the element array follows it */
+struct vector_file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t elem_size;
+	uint64_t size;
+	char reserved[32];
+};
+
 /* function prototypes */
 static void __vector_iter_head(iterator_t *it, vector_t *v);
 static void __vector_iter_next(iterator_t *it, vector_t *v);
 static void __vector_iter_tail(iterator_t *it, vector_t *v);
 static void __vector_iter_prev(iterator_t *it, vector_t *v);
+static void __vector_grow(vector_t *v, size_t n);
+static size_t __vector_map_length(vector_t *v, size_t n);
+static void __vector_remap(vector_t *v, size_t n);
+static void __vector_unmap_file(vector_t *v, size_t n);
+static void __vector_copy_n(vector_t *v, void *dest, void *src, size_t n);
 
 /* initialize the vector */
 void vector_init(vector_t *v, size_t elem_size,
@@ -12,10 +37,13 @@ void vector_init(vector_t *v, size_t elem_size,
 {
 	assert(v);
 
-	v->array = malloc(elem_size * DEFAULT_CONTAINER_CAPACITY);
-	assert(v->array);
-	v->capacity = DEFAULT_CONTAINER_CAPACITY;
+	/* storage is allocated by the first insertion */
+	v->array = NULL;
+	v->capacity = 0;
 	v->size = 0;
+	v->inline_buf = NULL;
+	v->inline_capacity = 0;
+	v->flags = 0;
 	v->elem_size = elem_size;
 	v->copy = copy_func;
 	v->free = free_func;
@@ -25,13 +53,99 @@ void vector_init(vector_t *v, size_t elem_size,
 	v->iter_prev = __vector_iter_prev;
 }
 
+/* initialize the vector on a caller supplied buffer, heap is used on overflow */
+void vector_init_inline(vector_t *v, size_t elem_size,
+		void *buf, size_t buf_capacity,
+		void (*copy_func)(void *, void *), void (*free_func)(void *))
+{
+	assert(v && buf && buf_capacity > 0);
+
+	vector_init(v, elem_size, copy_func, free_func);
+	v->array = buf;
+	v->capacity = buf_capacity;
+	v->inline_buf = buf;
+	v->inline_capacity = buf_capacity;
+}
+
+/* initialize the vector on anonymous mappings, for very large vectors */
+void vector_init_huge(vector_t *v, size_t elem_size,
+		void (*copy_func)(void *, void *), void (*free_func)(void *))
+{
+	assert(v);
+
+	vector_init(v, elem_size, copy_func, free_func);
+	v->flags |= VECTOR_MMAP;
+}
+
+/* reserves storage */
+void vector_reserve(vector_t *v, size_t n)
+{
+	assert(v && n >= v->size);
+
+	/* a mapped file is released even when it holds no element */
+	if (v->flags & VECTOR_MAPPED) {
+		if (v->capacity != n || n == 0) {
+			__vector_unmap_file(v, n);
+		}
+		return;
+	}
+
+	if (v->capacity == n) {
+		return;
+	}
+
+	if (v->flags & VECTOR_MMAP) {
+		__vector_remap(v, n);
+		return;
+	}
+
+	/* fits in the inline buffer, move back to it */
+	if (v->inline_buf != NULL && n <= v->inline_capacity) {
+		if (v->array != v->inline_buf) {
+			memcpy(v->inline_buf, v->array, v->size * v->elem_size);
+			free(v->array);
+			v->array = v->inline_buf;
+			v->capacity = v->inline_capacity;
+		}
+		return;
+	}
+
+	if (n == 0) {
+		free(v->array);
+		v->array = NULL;
+	} else if (v->array != NULL && v->array == v->inline_buf) {
+		void *array = malloc(n * v->elem_size);
+		assert(array);
+		memcpy(array, v->array, v->size * v->elem_size);
+		v->array = array;
+	} else {
+		v->array = realloc(v->array, n * v->elem_size);
+		assert(v->array);
+	}
+	v->capacity = n;
+}
+
+/* resizes storage, set extended storage to zero */
+void vector_resize(vector_t *v, size_t n)
+{
+	assert(v && n >= v->size);
+
+	vector_reserve(v, n);
+	if (n > v->size) {
+		void *dest = (char *)v->array + v->elem_size * v->size;
+		size_t length = (n - v->size) * v->elem_size;
+		memset(dest, 0, length);
+	}
+	v->size = n;
+}
+
 /* inserts elements */
 void vector_insert(vector_t *v, void *element, size_t position)
 {
-	assert(v && v->array && element && position <= v->size);
+	assert(v && element && position <= v->size);
 
 	if (v->size == v->capacity) {
-		vector_reserve(v, v->capacity * 2);
+		__vector_grow(v, 1);
 	}
 
 	char *pos_ptr = (char *)v->array + position * v->elem_size;
@@ -59,7 +173,7 @@ void vector_replace(vector_t *v, void *element, size_t position)
 /* clears the contents */
 void vector_clear(vector_t *v)
 {
-	assert(v && v->array);
+	assert(v);
 
 	if (v->free != NULL) {
 		size_t i;
@@ -67,6 +181,8 @@ void vector_clear(vector_t *v)
 			v->free((char *)v->array + i * v->elem_size);
 		}
 	}
+
+	/* capacity is kept, a huge vector gives pages back on shrink or destroy */
 	v->size = 0;
 }
 
@@ -85,6 +201,265 @@ void vector_delete(vector_t *v, size_t position)
 	v->size--;
 }
 
+/* inserts n contiguous elements at position */
+void vector_insert_range(vector_t *v, void *elements, size_t n, size_t position)
+{
+	assert(v && position <= v->size);
+
+	if (n == 0) {
+		return;
+	}
+
+	assert(elements);
+	__vector_grow(v, n);
+
+	char *pos_ptr = (char *)v->array + position * v->elem_size;
+	if (position < v->size) {
+		memmove(pos_ptr + n * v->elem_size, pos_ptr,
+				(v->size - position) * v->elem_size);
+	}
+	__vector_copy_n(v, pos_ptr, elements, n);
+	v->size += n;
+}
+
+/* erases elements in range [first, last) */
+void vector_erase_range(vector_t *v, size_t first, size_t last)
+{
+	assert(v && first <= last && last <= v->size);
+
+	if (first == last) {
+		return;
+	}
+
+	char *first_ptr = (char *)v->array + first * v->elem_size;
+	if (v->free != NULL) {
+		size_t i;
+		for (i = first; i < last; i++) {
+			v->free((char *)v->array + i * v->elem_size);
+		}
+	}
+
+	memmove(first_ptr, (char *)v->array + last * v->elem_size,
+			(v->size - last) * v->elem_size);
+	v->size -= last - first;
+}
+
+/* replaces the contents with n contiguous elements */
+void vector_assign(vector_t *v, void *elements, size_t n)
+{
+	assert(v);
+
+	vector_clear(v);
+	vector_insert_range(v, elements, n, 0);
+}
+
+/* writes the elements of a plain old data vector to file */
+int vector_save(vector_t *v, const char *path)
+{
+	assert(v && path && v->copy == NULL && v->free == NULL);
+
+	struct vector_file_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, VECTOR_FILE_MAGIC, sizeof(header.magic));
+	header.version = VECTOR_FILE_VERSION;
+	header.header_size = sizeof(header);
+	header.elem_size = v->elem_size;
+	header.size = v->size;
+
+	FILE *fp = fopen(path, "wb");
+	if (fp == NULL) {
+		return -1;
+	}
+
+	int ret = 0;
+	if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+			(v->size > 0 && fwrite(v->array, v->elem_size,
+					   v->size, fp) != v->size)) {
+		ret = -1;
+	}
+
+	if (fclose(fp) != 0) {
+		ret = -1;
+	}
+
+	return ret;
+}
+
+/*
+ * maps a file written by vector_save as the storage of the vector. The
+ * vector must be initialized with the elem_size of the file. A read only
+ * mapping must not be modified, a writable one is copy on write and is
+ * moved to the heap, or to an anonymous mapping for a huge vector, when
+ * it grows
+ */
+int vector_map(vector_t *v, const char *path, int readonly)
+{
+	assert(v && path && v->copy == NULL && v->free == NULL);
+
+	/* writes only go to private copies, so the file is never written */
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct stat st;
+	struct vector_file_header header;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(header) ||
+			pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+		close(fd);
+		return -1;
+	}
+
+	if (memcmp(header.magic, VECTOR_FILE_MAGIC, sizeof(header.magic)) ||
+			header.version != VECTOR_FILE_VERSION ||
+			header.header_size != sizeof(header) ||
+			header.elem_size != v->elem_size ||
+			header.size > ((size_t)st.st_size - sizeof(header)) /
+			header.elem_size ||
+			(size_t)st.st_size != sizeof(header) +
+			header.size * header.elem_size) {
+		close(fd);
+		return -1;
+	}
+
+	void *base = mmap(NULL, st.st_size,
+			readonly ? PROT_READ : (PROT_READ | PROT_WRITE),
+			readonly ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		return -1;
+	}
+
+	vector_clear(v);
+	vector_reserve(v, 0);
+	v->array = (char *)base + sizeof(header);
+	v->size = v->capacity = header.size;
+	v->flags = (v->flags & VECTOR_MMAP) | VECTOR_MAPPED |
+		(readonly ? VECTOR_READONLY : 0);
+
+	return 0;
+}
+
+/* makes room for n more elements, at most one reallocation */
+static void __vector_grow(vector_t *v, size_t n)
+{
+	assert(v);
+
+	size_t need = v->size + n;
+	if (need <= v->capacity) {
+		return;
+	}
+
+	size_t capacity = v->capacity ? v->capacity * 2 : DEFAULT_CONTAINER_CAPACITY;
+	if (capacity < need) {
+		capacity = need;
+	}
+	vector_reserve(v, capacity);
+}
+
+/* length of the mapping holding n elements, rounded to pages */
+static size_t __vector_map_length(vector_t *v, size_t n)
+{
+	static size_t page_size;
+	if (page_size == 0) {
+		page_size = (size_t)sysconf(_SC_PAGESIZE);
+	}
+
+	size_t length = n * v->elem_size;
+	return (length + page_size - 1) & ~(page_size - 1);
+}
+
+/* resizes the mapping, grows in place or moves pages without copying */
+static void __vector_remap(vector_t *v, size_t n)
+{
+	assert(v && (v->flags & VECTOR_MMAP));
+
+	size_t old_length = __vector_map_length(v, v->capacity);
+	size_t new_length = __vector_map_length(v, n);
+	void *array = v->array;
+
+	if (new_length == old_length) {
+		v->capacity = n;
+		return;
+	}
+
+	if (new_length == 0) {
+		munmap(array, old_length);
+		array = NULL;
+	} else if (array == NULL) {
+		array = mmap(NULL, new_length, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		assert(array != MAP_FAILED);
+	} else {
+#ifdef MREMAP_MAYMOVE
+		array = mremap(array, old_length, new_length, MREMAP_MAYMOVE);
+		assert(array != MAP_FAILED);
+#else
+		array = mmap(NULL, new_length, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		assert(array != MAP_FAILED);
+		memcpy(array, v->array, v->size * v->elem_size);
+		munmap(v->array, old_length);
+#endif
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (array != NULL) {
+		madvise(array, new_length, MADV_HUGEPAGE);
+	}
+#endif
+
+	v->array = array;
+	v->capacity = n;
+}
+
+/*
+ * moves a mapped vector file to the heap, or to an anonymous mapping for
+ * a huge vector, and unmaps it
+ */
+static void __vector_unmap_file(vector_t *v, size_t n)
+{
+	assert(v && (v->flags & VECTOR_MAPPED));
+
+	void *src = v->array;
+	void *base = (char *)src - sizeof(struct vector_file_header);
+	size_t length = sizeof(struct vector_file_header) +
+		v->capacity * v->elem_size;
+
+	v->flags &= ~(VECTOR_MAPPED | VECTOR_READONLY);
+	if (v->flags & VECTOR_MMAP) {
+		v->array = NULL;
+		v->capacity = 0;
+		__vector_remap(v, n);
+	} else {
+		v->array = (n > 0) ? malloc(n * v->elem_size) : NULL;
+		assert(v->array || n == 0);
+		v->capacity = n;
+	}
+
+	if (n > 0) {
+		memcpy(v->array, src, v->size * v->elem_size);
+	}
+	munmap(base, length);
+}
+
+/* copies n contiguous elements, one memcpy when there is no copy function */
+static void __vector_copy_n(vector_t *v, void *dest, void *src, size_t n)
+{
+	assert(v && dest && src);
+
+	if (v->copy == NULL) {
+		memcpy(dest, src, n * v->elem_size);
+		return;
+	}
+
+	size_t i;
+	for (i = 0; i < n; i++) {
+		v->copy((char *)dest + i * v->elem_size,
+				(char *)src + i * v->elem_size);
+	}
+}
+
 /* iterator head function for vector */
 static void __vector_iter_head(iterator_t *it, vector_t *v)
 {
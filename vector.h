@@ -7,14 +7,37 @@
 #include "iterator.h"
 
 #define VECTOR_INIT(v, elem_size)	vector_init((v), (elem_size), NULL, NULL)
+#define VECTOR_INIT_INLINE(v, elem_size, buf)	\
+	vector_init_inline((v), (elem_size), (buf),	\
+			sizeof(buf) / (elem_size), NULL, NULL)
+#define VECTOR_INIT_HUGE(v, elem_size)	\
+	vector_init_huge((v), (elem_size), NULL, NULL)
+
+/* vector flags */
+#define VECTOR_MMAP	0x1	/* storage is an anonymous mapping */
+#define VECTOR_MAPPED	0x2	/* storage is a mapped vector file */
+#define VECTOR_READONLY	0x4	/* mapped vector file is read only */
 
 typedef struct vector vector_t;
 
+/* element types understood by the search and reduction kernels */
+enum vector_type {
+	VECTOR_INT32,
+	VECTOR_UINT32,
+	VECTOR_INT64,
+	VECTOR_UINT64,
+	VECTOR_FLOAT,
+	VECTOR_DOUBLE
+};
+
 struct vector {
 	void *array;
 	size_t capacity;
 	size_t size;
 	size_t elem_size;
+	void *inline_buf;
+	size_t inline_capacity;
+	unsigned int flags;
 	void (*copy)(void *dest, void *src);
 	void (*free)(void *element);
 	void (*iter_head)(iterator_t *it, vector_t *v);
@@ -26,22 +49,38 @@ struct vector {
 /* function prototype */
 void vector_init(vector_t *v, size_t elem_size,
 		void (*copy_func)(void *, void *), void (*free_func)(void *));
+void vector_init_inline(vector_t *v, size_t elem_size,
+		void *buf, size_t buf_capacity,
+		void (*copy_func)(void *, void *), void (*free_func)(void *));
+void vector_init_huge(vector_t *v, size_t elem_size,
+		void (*copy_func)(void *, void *), void (*free_func)(void *));
+void vector_reserve(vector_t *v, size_t n);
+void vector_resize(vector_t *v, size_t n);
 void vector_insert(vector_t *v, void *element, size_t position);
 void vector_replace(vector_t *v, void *element, size_t position);
 void vector_clear(vector_t *v);
 void vector_delete(vector_t *v, size_t position);
+void vector_insert_range(vector_t *v, void *elements, size_t n, size_t position);
+void vector_erase_range(vector_t *v, size_t first, size_t last);
+void vector_assign(vector_t *v, void *elements, size_t n);
+int vector_save(vector_t *v, const char *path);
+int vector_map(vector_t *v, const char *path, int readonly);
+size_t vector_find(vector_t *v, enum vector_type type, const void *value);
+size_t vector_count(vector_t *v, enum vector_type type, const void *value);
+void vector_min_max(vector_t *v, enum vector_type type, void *min, void *max);
+void vector_sum(vector_t *v, enum vector_type type, void *sum);
+size_t vector_lower_bound(vector_t *v, enum vector_type type, const void *value);
 
 /* destroy vector, free memory */
 static inline void vector_destroy(vector_t *v)
 {
 	assert(v);
 
-	if (v->array != NULL) {
-		vector_clear(v);
-		free(v->array);
-		v->array = NULL;
-	}
-
+	vector_clear(v);
+	vector_reserve(v, 0);
+	v->array = NULL;
+	v->inline_buf = NULL;
+	v->inline_capacity = 0;
 	v->capacity = 0;
 }
 
@@ -87,13 +126,27 @@ static inline void* vector_back(vector_t *v)
 	return vector_at(v, v->size - 1);
 }
 
+/* reduces the capacity to the number of elements */
+static inline void vector_shrink_to_fit(vector_t *v)
+{
+	assert(v);
+	vector_reserve(v, v->size);
+}
+
 /* inserts elements to the end */
 static inline void vector_push_back(vector_t *v, void *element)
 {
-	assert(v && element && v->array);
+	assert(v && element);
 	vector_insert(v, element, v->size);
 }
 
+/* appends n contiguous elements to the end */
+static inline void vector_append_n(vector_t *v, void *elements, size_t n)
+{
+	assert(v);
+	vector_insert_range(v, elements, n, v->size);
+}
+
 /* removes the last element */
 static inline void vector_pop_back(vector_t *v)
 {
@@ -101,31 +154,4 @@ static inline void vector_pop_back(vector_t *v)
 	vector_delete(v, v->size - 1);
 }
 
-/* reserves storage */
-static inline void vector_reserve(vector_t *v, size_t n)
-{
-	assert(v && n >= v->size);
-
-	if (v->capacity != n) {
-		v->capacity = n;
-		v->array = realloc(v->array, v->capacity * v->elem_size);
-	}
-}
-
-/* resizes storage, set extended storage to zero */
-static inline void vector_resize(vector_t *v, size_t n)
-{
-	assert(v && n >= v->size);
-
-	if (v->capacity != n) {
-		v->capacity = n;
-		v->array = realloc(v->array, v->capacity * v->elem_size);
-	}
-
-	void *dest = (char *)v->array + v->elem_size * v->size;
-	size_t length = (n - v->size) * v->elem_size;
-	memset(dest, 0, length);
-	v->size = n;
-}
-
 #endif
@@ -0,0 +1,548 @@
+#include <stdint.h>
+#include "vector.h"
+
+/*
+ * search and reduction kernels over vectors of built-in numeric types.
+ * every kernel has a scalar version, x86 builds add SSE2 versions and, on
+ * x86_64 with gcc or clang, AVX2 versions selected at runtime.
+ */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define VECTOR_SSE2
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define VECTOR_AVX2
+#define AVX2	__attribute__((target("avx2")))
+#endif
+
+/* scalar kernels, also used for the tails of the simd loops */
+#define SCALAR_KERNELS(sfx, T, S)					\
+static inline size_t scalar_find_##sfx(const T *a, size_t n, T x)	\
+{									\
+	size_t i;							\
+	for (i = 0; i < n; i++) {					\
+		if (a[i] == x) {					\
+			return i;					\
+		}							\
+	}								\
+	return n;							\
+}									\
+									\
+static inline size_t scalar_count_##sfx(const T *a, size_t n, T x)	\
+{									\
+	size_t i, count = 0;						\
+	for (i = 0; i < n; i++) {					\
+		count += (a[i] == x);					\
+	}								\
+	return count;							\
+}									\
+									\
+static inline void scalar_min_max_##sfx(const T *a, size_t n,		\
+		T *min, T *max)						\
+{									\
+	size_t i;							\
+	for (i = 0; i < n; i++) {					\
+		if (a[i] < *min) {					\
+			*min = a[i];					\
+		}							\
+		if (a[i] > *max) {					\
+			*max = a[i];					\
+		}							\
+	}								\
+}									\
+									\
+static inline S scalar_sum_##sfx(const T *a, size_t n)			\
+{									\
+	size_t i;							\
+	S sum = 0;							\
+	for (i = 0; i < n; i++) {					\
+		sum += (S)a[i];						\
+	}								\
+	return sum;							\
+}									\
+									\
+/* branchless binary search, the sorted range must not contain nan */	\
+static inline size_t scalar_lower_bound_##sfx(const T *a, size_t n, T x)	\
+{									\
+	size_t lo = 0;							\
+	while (n > 1) {							\
+		size_t half = n / 2;					\
+		lo = (a[lo + half] < x) ? lo + half : lo;		\
+		n -= half;						\
+	}								\
+	return lo + (a[lo] < x);					\
+}
+
+SCALAR_KERNELS(i32, int32_t, int64_t)
+SCALAR_KERNELS(u32, uint32_t, uint64_t)
+SCALAR_KERNELS(i64, int64_t, uint64_t)
+SCALAR_KERNELS(u64, uint64_t, uint64_t)
+SCALAR_KERNELS(f32, float, double)
+SCALAR_KERNELS(f64, double, double)
+
+/*
+ * equality scans, CMP yields a mask with one bit per lane. equality does
+ * not depend on the sign, so the unsigned types use the signed kernels
+ */
+#define SIMD_SCAN_KERNELS(isa, attr, sfx, T, LANES, VT, SET1, LOAD, CMP)	\
+static attr size_t isa##_find_##sfx(const T *a, size_t n, T x)		\
+{									\
+	VT k = SET1(x);							\
+	size_t i;							\
+	for (i = 0; i + LANES <= n; i += LANES) {			\
+		int m = CMP(LOAD(a + i), k);				\
+		if (m) {						\
+			return i + __builtin_ctz(m);			\
+		}							\
+	}								\
+	return i + scalar_find_##sfx(a + i, n - i, x);			\
+}									\
+									\
+static attr size_t isa##_count_##sfx(const T *a, size_t n, T x)	\
+{									\
+	VT k = SET1(x);							\
+	size_t i, count = 0;						\
+	for (i = 0; i + LANES <= n; i += LANES) {			\
+		count += __builtin_popcount(CMP(LOAD(a + i), k));	\
+	}								\
+	return count + scalar_count_##sfx(a + i, n - i, x);		\
+}
+
+/* min and max reductions, both start from a[0] */
+#define SIMD_MIN_MAX_KERNEL(isa, attr, sfx, T, LANES, VT, LOAD, STORE, MIN, MAX)	\
+static attr void isa##_min_max_##sfx(const T *a, size_t n, T *min, T *max)	\
+{									\
+	size_t i = 0;							\
+	if (n >= LANES) {						\
+		VT lo = LOAD(a), hi = lo;				\
+		for (i = LANES; i + LANES <= n; i += LANES) {		\
+			VT e = LOAD(a + i);				\
+			lo = MIN(lo, e);				\
+			hi = MAX(hi, e);				\
+		}							\
+									\
+		T tmp[LANES];						\
+		STORE(tmp, lo);						\
+		scalar_min_max_##sfx(tmp, LANES, min, max);		\
+		STORE(tmp, hi);						\
+		scalar_min_max_##sfx(tmp, LANES, min, max);		\
+	}								\
+	scalar_min_max_##sfx(a + i, n - i, min, max);			\
+}
+
+#ifdef VECTOR_SSE2
+#define SSE2_LOAD_I(p)		_mm_loadu_si128((const __m128i *)(p))
+#define SSE2_CMP_I32(e, k)	\
+	_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32((e), (k))))
+/* sse2 has no 64-bit compare, both 32-bit halves must match */
+static inline int sse2_cmpeq_i64(__m128i e, __m128i k)
+{
+	__m128i c = _mm_cmpeq_epi32(e, k);
+	c = _mm_and_si128(c, _mm_shuffle_epi32(c, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_movemask_pd(_mm_castsi128_pd(c));
+}
+#define SSE2_CMP_F32(e, k)	_mm_movemask_ps(_mm_cmpeq_ps((e), (k)))
+#define SSE2_CMP_F64(e, k)	_mm_movemask_pd(_mm_cmpeq_pd((e), (k)))
+#define SSE2_SET1_I64(x)	_mm_set1_epi64x(x)
+
+SIMD_SCAN_KERNELS(sse2, , i32, int32_t, 4, __m128i, _mm_set1_epi32,
+		SSE2_LOAD_I, SSE2_CMP_I32)
+SIMD_SCAN_KERNELS(sse2, , i64, int64_t, 2, __m128i, SSE2_SET1_I64,
+		SSE2_LOAD_I, sse2_cmpeq_i64)
+SIMD_SCAN_KERNELS(sse2, , f32, float, 4, __m128, _mm_set1_ps,
+		_mm_loadu_ps, SSE2_CMP_F32)
+SIMD_SCAN_KERNELS(sse2, , f64, double, 2, __m128d, _mm_set1_pd,
+		_mm_loadu_pd, SSE2_CMP_F64)
+
+SIMD_MIN_MAX_KERNEL(sse2, , f32, float, 4, __m128, _mm_loadu_ps,
+		_mm_storeu_ps, _mm_min_ps, _mm_max_ps)
+SIMD_MIN_MAX_KERNEL(sse2, , f64, double, 2, __m128d, _mm_loadu_pd,
+		_mm_storeu_pd, _mm_min_pd, _mm_max_pd)
+#define sse2_min_max_i32	scalar_min_max_i32
+#define sse2_min_max_u32	scalar_min_max_u32
+#define sse2_min_max_i64	scalar_min_max_i64
+#define sse2_min_max_u64	scalar_min_max_u64
+
+static int64_t sse2_sum_i32(const int32_t *a, size_t n)
+{
+	__m128i acc = _mm_setzero_si128(), zero = _mm_setzero_si128();
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i e = SSE2_LOAD_I(a + i);
+		__m128i sign = _mm_cmpgt_epi32(zero, e);
+		acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(e, sign));
+		acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(e, sign));
+	}
+
+	int64_t tmp[2];
+	_mm_storeu_si128((__m128i *)tmp, acc);
+	return tmp[0] + tmp[1] + scalar_sum_i32(a + i, n - i);
+}
+
+static uint64_t sse2_sum_u32(const uint32_t *a, size_t n)
+{
+	__m128i acc = _mm_setzero_si128(), zero = _mm_setzero_si128();
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i e = SSE2_LOAD_I(a + i);
+		acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(e, zero));
+		acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(e, zero));
+	}
+
+	uint64_t tmp[2];
+	_mm_storeu_si128((__m128i *)tmp, acc);
+	return tmp[0] + tmp[1] + scalar_sum_u32(a + i, n - i);
+}
+
+static uint64_t sse2_sum_u64(const uint64_t *a, size_t n)
+{
+	__m128i acc = _mm_setzero_si128();
+	size_t i;
+	for (i = 0; i + 2 <= n; i += 2) {
+		acc = _mm_add_epi64(acc, SSE2_LOAD_I(a + i));
+	}
+
+	uint64_t tmp[2];
+	_mm_storeu_si128((__m128i *)tmp, acc);
+	return tmp[0] + tmp[1] + scalar_sum_u64(a + i, n - i);
+}
+
+static double sse2_sum_f32(const float *a, size_t n)
+{
+	__m128d acc = _mm_setzero_pd();
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 e = _mm_loadu_ps(a + i);
+		acc = _mm_add_pd(acc, _mm_cvtps_pd(e));
+		acc = _mm_add_pd(acc, _mm_cvtps_pd(_mm_movehl_ps(e, e)));
+	}
+
+	double tmp[2];
+	_mm_storeu_pd(tmp, acc);
+	return tmp[0] + tmp[1] + scalar_sum_f32(a + i, n - i);
+}
+
+static double sse2_sum_f64(const double *a, size_t n)
+{
+	__m128d acc = _mm_setzero_pd();
+	size_t i;
+	for (i = 0; i + 2 <= n; i += 2) {
+		acc = _mm_add_pd(acc, _mm_loadu_pd(a + i));
+	}
+
+	double tmp[2];
+	_mm_storeu_pd(tmp, acc);
+	return tmp[0] + tmp[1] + scalar_sum_f64(a + i, n - i);
+}
+#else
+#define sse2_find_i32		scalar_find_i32
+#define sse2_find_i64		scalar_find_i64
+#define sse2_find_f32		scalar_find_f32
+#define sse2_find_f64		scalar_find_f64
+#define sse2_count_i32		scalar_count_i32
+#define sse2_count_i64		scalar_count_i64
+#define sse2_count_f32		scalar_count_f32
+#define sse2_count_f64		scalar_count_f64
+#define sse2_min_max_i32	scalar_min_max_i32
+#define sse2_min_max_u32	scalar_min_max_u32
+#define sse2_min_max_i64	scalar_min_max_i64
+#define sse2_min_max_u64	scalar_min_max_u64
+#define sse2_min_max_f32	scalar_min_max_f32
+#define sse2_min_max_f64	scalar_min_max_f64
+#define sse2_sum_i32		scalar_sum_i32
+#define sse2_sum_u32		scalar_sum_u32
+#define sse2_sum_u64		scalar_sum_u64
+#define sse2_sum_f32		scalar_sum_f32
+#define sse2_sum_f64		scalar_sum_f64
+#endif
+
+#ifdef VECTOR_AVX2
+#define AVX2_LOAD_I(p)		_mm256_loadu_si256((const __m256i *)(p))
+#define AVX2_STORE_I(p, x)	_mm256_storeu_si256((__m256i *)(p), (x))
+#define AVX2_CMP_I32(e, k)	\
+	_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32((e), (k))))
+#define AVX2_CMP_I64(e, k)	\
+	_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64((e), (k))))
+#define AVX2_CMP_F32(e, k)	\
+	_mm256_movemask_ps(_mm256_cmp_ps((e), (k), _CMP_EQ_OQ))
+#define AVX2_CMP_F64(e, k)	\
+	_mm256_movemask_pd(_mm256_cmp_pd((e), (k), _CMP_EQ_OQ))
+#define AVX2_SET1_I64(x)	_mm256_set1_epi64x(x)
+
+SIMD_SCAN_KERNELS(avx2, AVX2, i32, int32_t, 8, __m256i, _mm256_set1_epi32,
+		AVX2_LOAD_I, AVX2_CMP_I32)
+SIMD_SCAN_KERNELS(avx2, AVX2, i64, int64_t, 4, __m256i, AVX2_SET1_I64,
+		AVX2_LOAD_I, AVX2_CMP_I64)
+SIMD_SCAN_KERNELS(avx2, AVX2, f32, float, 8, __m256, _mm256_set1_ps,
+		_mm256_loadu_ps, AVX2_CMP_F32)
+SIMD_SCAN_KERNELS(avx2, AVX2, f64, double, 4, __m256d, _mm256_set1_pd,
+		_mm256_loadu_pd, AVX2_CMP_F64)
+
+SIMD_MIN_MAX_KERNEL(avx2, AVX2, i32, int32_t, 8, __m256i, AVX2_LOAD_I,
+		AVX2_STORE_I, _mm256_min_epi32, _mm256_max_epi32)
+SIMD_MIN_MAX_KERNEL(avx2, AVX2, u32, uint32_t, 8, __m256i, AVX2_LOAD_I,
+		AVX2_STORE_I, _mm256_min_epu32, _mm256_max_epu32)
+SIMD_MIN_MAX_KERNEL(avx2, AVX2, f32, float, 8, __m256, _mm256_loadu_ps,
+		_mm256_storeu_ps, _mm256_min_ps, _mm256_max_ps)
+SIMD_MIN_MAX_KERNEL(avx2, AVX2, f64, double, 4, __m256d, _mm256_loadu_pd,
+		_mm256_storeu_pd, _mm256_min_pd, _mm256_max_pd)
+#define avx2_min_max_i64	scalar_min_max_i64
+#define avx2_min_max_u64	scalar_min_max_u64
+
+static AVX2 int64_t avx2_sum_i32(const int32_t *a, size_t n)
+{
+	__m256i acc = _mm256_setzero_si256();
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i e = AVX2_LOAD_I(a + i);
+		acc = _mm256_add_epi64(acc,
+				_mm256_cvtepi32_epi64(_mm256_castsi256_si128(e)));
+		acc = _mm256_add_epi64(acc,
+				_mm256_cvtepi32_epi64(_mm256_extracti128_si256(e, 1)));
+	}
+
+	int64_t tmp[4];
+	AVX2_STORE_I(tmp, acc);
+	return tmp[0] + tmp[1] + tmp[2] + tmp[3] + scalar_sum_i32(a + i, n - i);
+}
+
+static AVX2 uint64_t avx2_sum_u32(const uint32_t *a, size_t n)
+{
+	__m256i acc = _mm256_setzero_si256();
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i e = AVX2_LOAD_I(a + i);
+		acc = _mm256_add_epi64(acc,
+				_mm256_cvtepu32_epi64(_mm256_castsi256_si128(e)));
+		acc = _mm256_add_epi64(acc,
+				_mm256_cvtepu32_epi64(_mm256_extracti128_si256(e, 1)));
+	}
+
+	uint64_t tmp[4];
+	AVX2_STORE_I(tmp, acc);
+	return tmp[0] + tmp[1] + tmp[2] + tmp[3] + scalar_sum_u32(a + i, n - i);
+}
+
+static AVX2 uint64_t avx2_sum_u64(const uint64_t *a, size_t n)
+{
+	__m256i acc = _mm256_setzero_si256();
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		acc = _mm256_add_epi64(acc, AVX2_LOAD_I(a + i));
+	}
+
+	uint64_t tmp[4];
+	AVX2_STORE_I(tmp, acc);
+	return tmp[0] + tmp[1] + tmp[2] + tmp[3] + scalar_sum_u64(a + i, n - i);
+}
+
+static AVX2 double avx2_sum_f32(const float *a, size_t n)
+{
+	__m256d acc = _mm256_setzero_pd();
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256 e = _mm256_loadu_ps(a + i);
+		acc = _mm256_add_pd(acc,
+				_mm256_cvtps_pd(_mm256_castps256_ps128(e)));
+		acc = _mm256_add_pd(acc,
+				_mm256_cvtps_pd(_mm256_extractf128_ps(e, 1)));
+	}
+
+	double tmp[4];
+	_mm256_storeu_pd(tmp, acc);
+	return tmp[0] + tmp[1] + tmp[2] + tmp[3] + scalar_sum_f32(a + i, n - i);
+}
+
+static AVX2 double avx2_sum_f64(const double *a, size_t n)
+{
+	__m256d acc = _mm256_setzero_pd();
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		acc = _mm256_add_pd(acc, _mm256_loadu_pd(a + i));
+	}
+
+	double tmp[4];
+	_mm256_storeu_pd(tmp, acc);
+	return tmp[0] + tmp[1] + tmp[2] + tmp[3] + scalar_sum_f64(a + i, n - i);
+}
+
+/* checks once whether the cpu supports avx2 */
+static int __has_avx2(void)
+{
+	static int avx2 = -1;
+	if (avx2 < 0) {
+		__builtin_cpu_init();
+		avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+	return avx2;
+}
+
+#define DISPATCH(fn, ...)	\
+	(__has_avx2() ? avx2_##fn(__VA_ARGS__) : sse2_##fn(__VA_ARGS__))
+#else
+#define DISPATCH(fn, ...)	sse2_##fn(__VA_ARGS__)
+#endif
+
+/* size in bytes of the element type */
+static size_t __vector_type_size(enum vector_type type)
+{
+	switch (type) {
+	case VECTOR_INT32:
+	case VECTOR_UINT32:
+	case VECTOR_FLOAT:
+		return 4;
+	case VECTOR_INT64:
+	case VECTOR_UINT64:
+	case VECTOR_DOUBLE:
+		return 8;
+	}
+	return 0;
+}
+
+/* returns the position of the first element equal to value, or the size */
+size_t vector_find(vector_t *v, enum vector_type type, const void *value)
+{
+	assert(v && value && v->elem_size == __vector_type_size(type));
+
+	const void *a = v->array;
+	size_t n = v->size;
+	if (n == 0) {
+		return 0;
+	}
+
+	switch (type) {
+	case VECTOR_INT32:
+	case VECTOR_UINT32:
+		return DISPATCH(find_i32, a, n, *(const int32_t *)value);
+	case VECTOR_INT64:
+	case VECTOR_UINT64:
+		return DISPATCH(find_i64, a, n, *(const int64_t *)value);
+	case VECTOR_FLOAT:
+		return DISPATCH(find_f32, a, n, *(const float *)value);
+	case VECTOR_DOUBLE:
+		return DISPATCH(find_f64, a, n, *(const double *)value);
+	}
+	return n;
+}
+
+/* returns the number of elements equal to value */
+size_t vector_count(vector_t *v, enum vector_type type, const void *value)
+{
+	assert(v && value && v->elem_size == __vector_type_size(type));
+
+	const void *a = v->array;
+	size_t n = v->size;
+	if (n == 0) {
+		return 0;
+	}
+
+	switch (type) {
+	case VECTOR_INT32:
+	case VECTOR_UINT32:
+		return DISPATCH(count_i32, a, n, *(const int32_t *)value);
+	case VECTOR_INT64:
+	case VECTOR_UINT64:
+		return DISPATCH(count_i64, a, n, *(const int64_t *)value);
+	case VECTOR_FLOAT:
+		return DISPATCH(count_f32, a, n, *(const float *)value);
+	case VECTOR_DOUBLE:
+		return DISPATCH(count_f64, a, n, *(const double *)value);
+	}
+	return 0;
+}
+
+/* stores the smallest and the largest element, the vector must not be empty */
+void vector_min_max(vector_t *v, enum vector_type type, void *min, void *max)
+{
+	assert(v && min && max && !vector_empty(v));
+	assert(v->elem_size == __vector_type_size(type));
+
+	const void *a = v->array;
+	size_t n = v->size;
+	memcpy(min, a, v->elem_size);
+	memcpy(max, a, v->elem_size);
+
+	switch (type) {
+	case VECTOR_INT32:
+		DISPATCH(min_max_i32, a, n, min, max);
+		break;
+	case VECTOR_UINT32:
+		DISPATCH(min_max_u32, a, n, min, max);
+		break;
+	case VECTOR_INT64:
+		DISPATCH(min_max_i64, a, n, min, max);
+		break;
+	case VECTOR_UINT64:
+		DISPATCH(min_max_u64, a, n, min, max);
+		break;
+	case VECTOR_FLOAT:
+		DISPATCH(min_max_f32, a, n, min, max);
+		break;
+	case VECTOR_DOUBLE:
+		DISPATCH(min_max_f64, a, n, min, max);
+		break;
+	}
+}
+
+/*
+ * stores the sum of the elements: int64_t for signed integers, uint64_t for
+ * unsigned integers and double for floating point types
+ */
+void vector_sum(vector_t *v, enum vector_type type, void *sum)
+{
+	assert(v && sum && v->elem_size == __vector_type_size(type));
+
+	const void *a = v->array;
+	size_t n = v->size;
+
+	switch (type) {
+	case VECTOR_INT32:
+		*(int64_t *)sum = n ? DISPATCH(sum_i32, a, n) : 0;
+		break;
+	case VECTOR_UINT32:
+		*(uint64_t *)sum = n ? DISPATCH(sum_u32, a, n) : 0;
+		break;
+	case VECTOR_INT64:
+		*(int64_t *)sum = n ? (int64_t)DISPATCH(sum_u64, a, n) : 0;
+		break;
+	case VECTOR_UINT64:
+		*(uint64_t *)sum = n ? DISPATCH(sum_u64, a, n) : 0;
+		break;
+	case VECTOR_FLOAT:
+		*(double *)sum = n ? DISPATCH(sum_f32, a, n) : 0;
+		break;
+	case VECTOR_DOUBLE:
+		*(double *)sum = n ? DISPATCH(sum_f64, a, n) : 0;
+		break;
+	}
+}
+
+/* returns the position of the first element not less than value, the vector must be sorted */
+size_t vector_lower_bound(vector_t *v, enum vector_type type, const void *value)
+{
+	assert(v && value && v->elem_size == __vector_type_size(type));
+
+	const void *a = v->array;
+	size_t n = v->size;
+	if (n == 0) {
+		return 0;
+	}
+
+	switch (type) {
+	case VECTOR_INT32:
+		return scalar_lower_bound_i32(a, n, *(const int32_t *)value);
+	case VECTOR_UINT32:
+		return scalar_lower_bound_u32(a, n, *(const uint32_t *)value);
+	case VECTOR_INT64:
+		return scalar_lower_bound_i64(a, n, *(const int64_t *)value);
+	case VECTOR_UINT64:
+		return scalar_lower_bound_u64(a, n, *(const uint64_t *)value);
+	case VECTOR_FLOAT:
+		return scalar_lower_bound_f32(a, n, *(const float *)value);
+	case VECTOR_DOUBLE:
+		return scalar_lower_bound_f64(a, n, *(const double *)value);
+	}
+	return n;
+}